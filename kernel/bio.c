@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,6 +12,31 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// Each bucket of the hash table has its own lock, so that
+// processes using different blocks don't contend. There is no
+// global LRU list: a buffer records when it was last used, and
+// a miss recycles the free buffer used longest ago, wherever
+// it is, moving it to the block's bucket.
+//
+// Which buffer that is follows 2Q, so that reading a big file
+// once doesn't push out the blocks everyone keeps using: a
+// block read in goes on A1IN, where it ages from when it came
+// in, however often it is used. The blocks most recently
+// recycled from A1IN are remembered, without their data, on
+// a ghost list; a block read in again while remembered there
+// goes on AM instead, where it ages from when it was last
+// released. A miss recycles from A1IN while A1IN holds more
+// than a quarter of the cache, so a scan recycles its own
+// blocks and leaves AM alone.
+//
+// The cache's memory comes from kalloc(), a page at a time,
+// each page holding the data of a group of BPERPAGE buffers.
+// It starts at NBUFMIN buffers and grows on a miss while
+// there is free memory, up to NBUFMAX; when kalloc() runs out,
+// it calls bshrink() to free pages whose buffers are all free.
+// Buffers with no block in them wait on a spare list, to be
+// used before recycling a cached block.
 
 
 #include "types.h"
@@ -23,69 +48,380 @@
 #include "fs.h"
 #include "buf.h"
 
+#define NBUCKET 13
+#define BHASH(dev, blockno) (((dev) * 7 + (blockno)) % NBUCKET)
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;     // buffers on this bucket, through next
+};
+
+#define BPERPAGE (PGSIZE / BSIZE)
+#define NGROUP (NBUFMAX / BPERPAGE)
+#define NGROUPMIN ((NBUFMIN + BPERPAGE - 1) / BPERPAGE)
+#define SPARE (-2)      // b->bucket of a buffer on the spare list
+
+// the 2Q queues.
+#define A1IN 0          // blocks used once, lately
+#define AM   1          // blocks used again while on the ghost list
+#define NGHOST (NBUFMAX / 2)
+#define NGHASH 61
+
 struct {
+  struct buf buf[NBUFMAX];        // group g is buf[g*BPERPAGE..]
+  struct bucket bucket[NBUCKET];
+
+  // lock must be held when using these. it is taken
+  // before any bucket's lock, never while holding one.
   struct spinlock lock;
-  struct buf buf[NBUF];
+  uchar *page[NGROUP];  // each group's data, or 0 if it has none
+  int ngroup;           // groups with pages
+  int hand;             // where bshrink() looks next
+  struct buf *spare;    // free buffers holding no block, through next
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  int nqueue[2];        // buffers on A1IN and AM; updated atomically
 } bcache;
 
+// the ghost list: the blocks last recycled from A1IN,
+// in a ring, oldest first from seq % NGHOST, and hashed
+// for lookup.
+struct ghost {
+  uint dev;
+  uint blockno;
+  uint64 seq;           // when it was remembered, counting from 1
+  struct ghost *next;   // on its hash chain
+};
+
+static struct {
+  struct spinlock lock;
+  struct ghost ring[NGHOST];
+  struct ghost *hash[NGHASH];
+  uint64 seq;           // remembered so far
+} ghosts;
+
+// updated atomically.
+static struct {
+  uint64 nhit;
+  uint64 nmiss;
+  uint64 nghosthit;     // misses on blocks the ghost list remembered
+  uint64 nevict[2];     // misses that recycled a block from A1IN, AM
+  uint64 nraced;        // misses that found the block cached after all
+  uint64 nretry;        // recycling scans that lost a race for the buffer
+  uint64 ngrow;         // pages added
+  uint64 nshrink;       // pages given back to kalloc()
+} bstats;
+
+static void
+putspare(struct buf *b)
+{
+  b->dev = 0;
+  b->blockno = 0;
+  b->valid = 0;
+  b->refcnt = 0;
+  b->lastuse = 0;
+  b->bucket = SPARE;
+  b->next = bcache.spare;
+  bcache.spare = b;
+}
+
+// give group g the page pa and put its buffers on
+// the spare list. bcache.lock must be held.
+static void
+addgroup(int g, uchar *pa)
+{
+  struct buf *b;
+  int i;
+
+  bcache.page[g] = pa;
+  bcache.ngroup++;
+  for(i = 0; i < BPERPAGE; i++){
+    b = &bcache.buf[g*BPERPAGE + i];
+    b->data = pa + i*BSIZE;
+    putspare(b);
+  }
+}
+
+// add a group, if there is memory to spare and room for
+// one. bcache.lock must be held.
+static int
+grow(void)
+{
+  uchar *pa;
+  int g;
+
+  if(bcache.ngroup == NGROUP)
+    return 0;
+  // don't take memory from other caches to grow this one.
+  if((pa = kalloc_noreclaim()) == 0)
+    return 0;
+  for(g = 0; bcache.page[g]; g++)
+    ;
+  addgroup(g, pa);
+  __sync_fetch_and_add(&bstats.ngrow, 1);
+  return 1;
+}
+
+// a spare buffer, with a reference, growing the cache
+// for one if need be; or 0.
+static struct buf*
+getspare(void)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  if(bcache.spare == 0)
+    grow();
+  if((b = bcache.spare) != 0){
+    bcache.spare = b->next;
+    b->next = 0;
+    b->bucket = -1;
+    b->refcnt = 1;
+  }
+  release(&bcache.lock);
+  return b;
+}
+
+// take b off the spare list. bcache.lock must be held.
+static void
+takespare(struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bcache.spare; *pp != b; pp = &(*pp)->next)
+    ;
+  *pp = b->next;
+  b->next = 0;
+  b->bucket = -1;
+}
+
+#define GHASH(dev, blockno) (((dev) * 7 + (blockno)) % NGHASH)
+
+// remember that (dev, blockno) was recycled from A1IN,
+// forgetting the oldest block remembered.
+static void
+remember(uint dev, uint blockno)
+{
+  struct ghost *g, **pp;
+
+  acquire(&ghosts.lock);
+  g = &ghosts.ring[ghosts.seq % NGHOST];
+  if(g->seq){
+    for(pp = &ghosts.hash[GHASH(g->dev, g->blockno)]; *pp != g; pp = &(*pp)->next)
+      ;
+    *pp = g->next;
+  }
+  g->dev = dev;
+  g->blockno = blockno;
+  g->seq = ++ghosts.seq;
+  pp = &ghosts.hash[GHASH(dev, blockno)];
+  g->next = *pp;
+  *pp = g;
+  release(&ghosts.lock);
+}
+
+// was (dev, blockno) recycled from A1IN lately? only the last
+// half a cache's worth count, as the cache changes size.
+// forgets it either way.
+static int
+forget(uint dev, uint blockno)
+{
+  struct ghost *g, **pp;
+  uint64 kout;
+  int found = 0;
+
+  kout = bcache.ngroup * BPERPAGE / 2;
+  acquire(&ghosts.lock);
+  for(pp = &ghosts.hash[GHASH(dev, blockno)]; (g = *pp) != 0; pp = &g->next){
+    if(g->dev == dev && g->blockno == blockno){
+      found = g->seq + kout > ghosts.seq;
+      // leave its ring slot to be overwritten in turn.
+      *pp = g->next;
+      g->seq = 0;
+      break;
+    }
+  }
+  release(&ghosts.lock);
+  return found;
+}
+
+static int bshrink(int);
+
 void
 binit(void)
 {
+  struct bucket *bk;
   struct buf *b;
+  uchar *pa;
+  int g;
 
-  initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlockkind(&bk->lock, "bcache", LOCK_MCS);
+  initlock(&bcache.lock, "bgroups");
+  initlock(&ghosts.lock, "bghost");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  for(b = bcache.buf; b < bcache.buf+NBUFMAX; b++){
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->bucket = -1;
   }
+
+  acquire(&bcache.lock);
+  for(g = 0; g < NGROUPMIN; g++){
+    if((pa = kalloc_noreclaim()) == 0)
+      panic("binit");
+    addgroup(g, pa);
+  }
+  release(&bcache.lock);
+
+  kshrinker(bshrink);
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// the buffer for (dev, blockno) on bk, with a reference
+// added, or 0. bk->lock must be held.
 static struct buf*
-bget(uint dev, uint blockno)
+lookup(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+// take b off bk. bk->lock must be held.
+static void
+unlink(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp != b; pp = &(*pp)->next)
+    ;
+  *pp = b->next;
+  b->next = 0;
+  b->bucket = -1;
+  __sync_fetch_and_add(&bcache.nqueue[b->queue], -1);
+}
+
+// put b on bk, and on queue q. bk->lock must be held.
+static void
+link(struct bucket *bk, struct buf *b, int q)
+{
+  b->next = bk->head;
+  b->bucket = bk - bcache.bucket;
+  b->queue = q;
+  bk->head = b;
+  __sync_fetch_and_add(&bcache.nqueue[q], 1);
+}
+
+// take the free buffer used longest ago off its bucket, with
+// a reference so that no one else takes it: from A1IN if it
+// holds more than its share or AM has none free, else from
+// AM. looks at one bucket at a time, so the buffer may be
+// taken before it can be claimed; then look again.
+static struct buf*
+recycle(void)
+{
+  struct buf *b, *best, *oldest[2];
+  struct bucket *bk;
+  int i, besti, q, bucketof[2];
+
+  for(;;){
+    oldest[A1IN] = oldest[AM] = 0;
+    bucketof[A1IN] = bucketof[AM] = 0;
+    for(i = 0; i < NBUCKET; i++){
+      bk = &bcache.bucket[i];
+      acquire(&bk->lock);
+      for(b = bk->head; b; b = b->next){
+        q = b->queue;
+        if(b->refcnt == 0 && (oldest[q] == 0 || b->lastuse < oldest[q]->lastuse)){
+          oldest[q] = b;
+          bucketof[q] = i;
+        }
+      }
+      release(&bk->lock);
     }
+    if(oldest[A1IN] && (oldest[AM] == 0 ||
+                        bcache.nqueue[A1IN] > bcache.ngroup * BPERPAGE / 4))
+      q = A1IN;
+    else if(oldest[AM])
+      q = AM;
+    else
+      panic("bget: no buffers");
+    best = oldest[q];
+    besti = bucketof[q];
+
+    bk = &bcache.bucket[besti];
+    acquire(&bk->lock);
+    if(best->bucket == besti && best->refcnt == 0 && best->queue == q){
+      best->refcnt = 1;
+      unlink(bk, best);
+      release(&bk->lock);
+      __sync_fetch_and_add(&bstats.nevict[q], 1);
+      if(q == A1IN)
+        remember(best->dev, best->blockno);
+      return best;
+    }
+    release(&bk->lock);
+    __sync_fetch_and_add(&bstats.nretry, 1);
   }
-  panic("bget: no buffers");
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b, *nb;
+  int q, h = BHASH(dev, blockno);
+  struct bucket *bk = &bcache.bucket[h];
+
+  // Is the block already cached?
+  acquire(&bk->lock);
+  b = lookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    __sync_fetch_and_add(&bstats.nhit, 1);
+    acquiresleep(&b->lock);
+    return b;
+  }
+
+  // Not cached. Use a spare buffer, growing the cache if
+  // there is memory, or else recycle one, without holding
+  // bk->lock, since these take other locks.
+  __sync_fetch_and_add(&bstats.nmiss, 1);
+  if((nb = getspare()) == 0)
+    nb = recycle();
+  // a block recycled from A1IN lately is in use after all.
+  q = A1IN;
+  if(forget(dev, blockno)){
+    __sync_fetch_and_add(&bstats.nghosthit, 1);
+    q = AM;
+  }
+
+  acquire(&bk->lock);
+  if((b = lookup(bk, dev, blockno)) != 0){
+    // another process cached the block meanwhile.
+    // keep nb for the next miss.
+    release(&bk->lock);
+    __sync_fetch_and_add(&bstats.nraced, 1);
+    acquire(&bcache.lock);
+    putspare(nb);
+    release(&bcache.lock);
+  } else {
+    b = nb;
+    b->dev = dev;
+    b->blockno = blockno;
+    b->valid = 0;
+    b->lastuse = r_time();
+    link(bk, b, q);
+    release(&bk->lock);
+  }
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -112,42 +448,135 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// If no one else is using it and it is on AM, note when,
+// for recycle(); buffers on A1IN age from when they came in.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b has a reference, so it stays on its bucket.
+  bk = &bcache.bucket[b->bucket];
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
+  if (b->refcnt == 0 && b->queue == AM) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+    b->lastuse = r_time();
+  }
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[b->bucket];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[b->bucket];
+
+  acquire(&bk->lock);
   b->refcnt--;
+  release(&bk->lock);
+}
+
+// claim b, of a group being freed, if it is free: off
+// the spare list or its bucket. bcache.lock must be held.
+static int
+claim(struct buf *b)
+{
+  struct bucket *bk;
+  int h = b->bucket;
+
+  if(h == SPARE){
+    takespare(b);
+    return 1;
+  }
+  if(h < 0)
+    return 0;
+  bk = &bcache.bucket[h];
+  acquire(&bk->lock);
+  if(b->bucket != h || b->refcnt != 0){
+    release(&bk->lock);
+    return 0;
+  }
+  unlink(bk, b);
+  release(&bk->lock);
+  return 1;
+}
+
+// the shrinker kalloc() calls when it runs out: free up to
+// n pages whose buffers are all free, looking at the groups
+// round-robin, and keeping at least NBUFMIN buffers.
+// returns how many pages it freed.
+static int
+bshrink(int n)
+{
+  struct buf *b, *grp;
+  int freed, g, i, looked;
+
+  freed = 0;
+  acquire(&bcache.lock);
+  for(looked = 0; looked < NGROUP && freed < n && bcache.ngroup > NGROUPMIN; looked++){
+    g = bcache.hand;
+    bcache.hand = (g + 1) % NGROUP;
+    if(bcache.page[g] == 0)
+      continue;
+    grp = &bcache.buf[g*BPERPAGE];
+
+    // don't throw away cached blocks for a group that
+    // can't be freed anyway. the buckets aren't locked,
+    // so claim() checks again.
+    for(b = grp; b < grp+BPERPAGE; b++)
+      if(b->bucket != SPARE && (b->bucket < 0 || b->refcnt != 0))
+        break;
+    if(b < grp+BPERPAGE)
+      continue;
+
+    for(i = 0; i < BPERPAGE && claim(&grp[i]); i++)
+      ;
+    if(i < BPERPAGE){
+      // one was taken meanwhile; the others are spares now.
+      while(--i >= 0)
+        putspare(&grp[i]);
+      continue;
+    }
+
+    kfree(bcache.page[g]);
+    bcache.page[g] = 0;
+    bcache.ngroup--;
+    for(b = grp; b < grp+BPERPAGE; b++)
+      b->data = 0;
+    freed++;
+  }
   release(&bcache.lock);
+  __sync_fetch_and_add(&bstats.nshrink, freed);
+  return freed;
 }
 
+int
+bcachestats(char *buf, int sz)
+{
+  uint64 n = bstats.nhit + bstats.nmiss;
+  int len;
 
+  len = snprintf(buf, sz, "bcache: %d buffers (%d-%d), %lu hits, %lu misses, %lu%% hit ratio, "
+                 "%lu pages grown, %lu shrunk, %lu raced, %lu recycle retries\n",
+                 bcache.ngroup * BPERPAGE, NGROUPMIN * BPERPAGE, NBUFMAX,
+                 bstats.nhit, bstats.nmiss, bstats.nhit * 100 / (n ? n : 1),
+                 bstats.ngrow, bstats.nshrink, bstats.nraced, bstats.nretry);
+  len += snprintf(buf+len, sz-len, "bcache 2q: %d on a1in, %d on am, %lu evicted from a1in, "
+                  "%lu from am, %lu ghost hits\n",
+                  bcache.nqueue[A1IN], bcache.nqueue[AM],
+                  bstats.nevict[A1IN], bstats.nevict[AM], bstats.nghosthit);
+  return len;
+}
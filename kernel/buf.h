@@ -5,8 +5,10 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
-  uchar data[BSIZE];
+  struct buf *next; // on its bcache bucket
+  int bucket;       // which, -1 while moving between them, or SPARE
+  int queue;        // A1IN or AM, for the 2Q policy in bio.c
+  uint64 lastuse;   // mtime when it entered A1IN, or last fell to refcnt 0 in AM
+  uchar *data;      // BSIZE bytes, in a page shared with its group
 };
 
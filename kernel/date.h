@@ -6,3 +6,9 @@ struct rtcdate {
   uint month;
   uint year;
 };
+
+// time since boot, for clock_gettime() and nanosleep().
+struct timespec {
+  uint64 sec;
+  uint64 nsec;
+};
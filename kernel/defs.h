@@ -2,12 +2,19 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct lockclass;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct work;
+struct rcu_head;
+struct waitqueue;
+struct waitentry;
+struct usyscall;
 
 // bio.c
 void            binit(void);
@@ -16,6 +23,7 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bcachestats(char*, int);
 
 // console.c
 void            consoleinit(void);
@@ -44,7 +52,10 @@ void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
 void            iunlockput(struct inode*);
+int             inodestats(char*, int);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -61,6 +72,8 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_noreclaim(void);
+void            kshrinker(int (*)(int));
 void            kfree(void *);
 void            kinit(void);
 
@@ -85,11 +98,22 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
-void            proc_mapstacks(pagetable_t);
+uint64          growproc(int);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
+int             onlythread(struct proc*);
+int             setaffinity(int, int);
+int             getaffinity(int);
+int             setpriority(int, int);
+int             getpriority(int);
+void            piblock(struct sleeplock*);
+void            piunblock(struct sleeplock*);
+void            piowner(struct sleeplock*, struct proc*);
+int             schedstats(char*, int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+struct proc*    kthread(char*, void (*)(void*), void*, int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -100,6 +124,7 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeproc(struct proc*, void*, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -112,15 +137,81 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initlockkind(struct spinlock*, char*, int);
+int             lockbench(int, int);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             preemptstats(char*, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
+int             heldshared(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+int             sleeplockstats(char*, int);
+
+// reaper.c
+void            reaperinit(void);
+void            reap(pagetable_t, uint64);
+int             reapwait(void);
+int             reapstats(char*, int);
+
+// workqueue.c
+void            workqueueinit(void);
+void            init_work(struct work*, void (*)(void*), void*);
+int             queue_work(struct work*);
+int             queue_work_on(int, struct work*);
+int             queue_delayed_work(struct work*, uint);
+int             workstats(char*, int);
+
+// rcu.c
+void            rcuinit(void);
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+void            rcu_qs(void);
+void            call_rcu(struct rcu_head*, void (*)(struct rcu_head*));
+void            synchronize_rcu(void);
+int             rcustats(char*, int);
+
+// waitqueue.c
+void            waitqueueinit(void);
+void            init_waitqueue(struct waitqueue*, char*);
+void            init_waitentry(struct waitentry*, int);
+void            wait_on(struct waitqueue*, struct waitentry*, struct spinlock*);
+void            wake_one(struct waitqueue*);
+void            wake_all(struct waitqueue*);
+int             waitqueuestats(char*, int);
+
+// lockstat.c
+struct lockclass* lockclass(char*, int);
+void            lockstatinit(void);
+
+// irq.c
+void            irqinit(void);
+void            irqinithart(void);
+void            irq_follow(int);
+int             irqsetaffinity(int, int);
+int             irqgetaffinity(int);
+void            irqintr(void);
+void            softirq(void);
+int             insoftirq(void);
+int             irqstats(char*, int);
+
+// futex.c
+void            futexinit(void);
+int             futex_wait(uint64, int, uint64);
+int             futex_wake(uint64, int);
+int             futexstats(char*, int);
+
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+
+// stats.c
+void            statsinit(void);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -139,16 +230,37 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+uint64          timer_now(void);
+uint            timer_ticks(void);
+void            timerinithart(void);
+void            timer_publish(struct usyscall*);
+void            wheelinit(void);
+void            timer_slice(void);
+void            timer_idle(void);
+void            timer_kick(int);
+void            timer_add(struct timer*, uint, void (*)(void*), void*);
+void            hrtimer_add(struct timer*, uint64, void (*)(void*), void*);
+int             timer_del(struct timer*);
+int             timer_del_sync(struct timer*);
+int             timer_sleep(uint);
+int             timer_nanosleep(uint64);
+int             timerintr(void);
+int             timerstats(char*, int);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
+void            tickupdate(void);
+void            clockintr(void);
 void            usertrapret(void);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
+void            uartbottom(void);
 void            uartputc(int);
 void            uartputc_sync(int);
 int             uartgetc(void);
@@ -176,11 +288,13 @@ void            plicinit(void);
 void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
+void            plic_setenable(int, uint);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_bottom(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
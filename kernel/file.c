@@ -23,6 +23,8 @@ void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  for(int i = 0; i < NFILE; i++)
+    initsleeplock(&ftable.file[i].offlock, "fileoff");
 }
 
 // Allocate a file structure.
@@ -91,9 +93,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -118,10 +120,16 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
+    // readers of the file share its inode lock, so those
+    // sharing this struct file take turns with the offset.
+    // a writer holds the inode lock exclusive, which keeps
+    // them out while it moves the offset.
+    acquiresleep(&f->offlock);
+    ilockshared(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
-    iunlock(f->ip);
+    iunlockshared(f->ip);
+    releasesleep(&f->offlock);
   } else {
     panic("fileread");
   }
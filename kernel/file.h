@@ -6,6 +6,7 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  struct sleeplock offlock; // with ip->lock shared, protects off
   short major;       // FD_DEVICE
 };
 
@@ -17,7 +18,9 @@ struct file {
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
-  int ref;            // Reference count
+  int ref;            // Reference count, changed atomically
+  struct inode *hnext; // itable hash chain, read under RCU
+  struct inode *nextfree; // on itable's free lists
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -38,3 +41,5 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define STATS   2
+#define LOCKSTAT 3
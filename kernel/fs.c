@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "rcu.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -142,7 +143,8 @@ bfree(int dev, uint b)
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
-//   has first locked the inode.
+//   has first locked the inode. Code that only examines
+//   them may lock it shared with ilockshared() instead.
 //
 // Thus a typical sequence is:
 //   ip = iget(dev, inum)
@@ -163,19 +165,38 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// entries. An entry in use is on the hash chain for its ip->dev
+// and ip->inum, which only change while it is off the chains.
+// iget() searches the chains without the lock, under RCU, so
+// ip->ref changes atomically, and an entry whose ref falls to
+// zero leaves its chain and waits out a grace period before
+// it is reused, so that a lock-free search that found it
+// can't see it change to another inode.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 31
+#define IHASH(dev, inum) (((dev) * 7 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];   // entries in use
+  struct inode *free;           // entries that can be reused,
+  struct inode *dying;          // that will be after the grace period under way,
+  struct inode *dead;           // and that will be after the one after.
+  struct rcu_head rcu;          // for the grace period under way, if dying
 } itable;
 
+// updated atomically.
+static struct {
+  uint64 nfast;       // iget()s that found the inode without itable.lock
+  uint64 nslow;       // that took itable.lock
+  uint64 nwait;       // waits for a grace period to free an entry
+} istats;
+
 void
 iinit()
 {
@@ -184,6 +205,8 @@ iinit()
   initlock(&itable.lock, "itable");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
+    itable.inode[i].nextfree = itable.free;
+    itable.free = &itable.inode[i];
   }
 }
 
@@ -242,31 +265,62 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  struct inode **chain = &itable.hash[IHASH(dev, inum)];
+  int ref;
+
+  // Is the inode already in the table? Usually it is,
+  // and there's no need to take itable.lock to find it.
+  rcu_read_lock();
+  for(ip = __atomic_load_n(chain, __ATOMIC_ACQUIRE); ip;
+      ip = __atomic_load_n(&ip->hnext, __ATOMIC_ACQUIRE)){
+    if(ip->dev != dev || ip->inum != inum)
+      continue;
+    // a ref of zero means it is leaving the table.
+    while((ref = __atomic_load_n(&ip->ref, __ATOMIC_RELAXED)) > 0){
+      if(__sync_bool_compare_and_swap(&ip->ref, ref, ref+1)){
+        rcu_read_unlock();
+        __sync_fetch_and_add(&istats.nfast, 1);
+        return ip;
+      }
+    }
+    break;
+  }
+  rcu_read_unlock();
 
+  __sync_fetch_and_add(&istats.nslow, 1);
   acquire(&itable.lock);
-
-  // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
+  for(;;){
+    // entries on a chain have refs, which can't fall
+    // to zero without itable.lock.
+    for(ip = *chain; ip; ip = ip->hnext){
+      if(ip->dev == dev && ip->inum == inum){
+        __sync_fetch_and_add(&ip->ref, 1);
+        release(&itable.lock);
+        return ip;
+      }
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    if(itable.free)
+      break;
+    if(itable.dying == 0)
+      panic("iget: no inodes");
+    // wait for entries to come free.
+    __sync_fetch_and_add(&istats.nwait, 1);
+    release(&itable.lock);
+    synchronize_rcu();
+    acquire(&itable.lock);
   }
 
   // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  ip = itable.free;
+  itable.free = ip->nextfree;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = *chain;
+  // make the entry complete before searches can find it.
+  __atomic_store_n(chain, ip, __ATOMIC_RELEASE);
   release(&itable.lock);
 
   return ip;
@@ -277,10 +331,62 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
+  // the caller's reference keeps ip in the table.
+  __sync_fetch_and_add(&ip->ref, 1);
+  return ip;
+}
+
+// the grace period for itable.dying is over: they are free.
+// start one for itable.dead, if there are any.
+static void
+ifree(struct rcu_head *h)
+{
+  struct inode *ip;
+
   acquire(&itable.lock);
-  ip->ref++;
+  while(itable.dying){
+    ip = itable.dying;
+    itable.dying = ip->nextfree;
+    ip->nextfree = itable.free;
+    itable.free = ip;
+  }
+  if(itable.dead){
+    itable.dying = itable.dead;
+    itable.dead = 0;
+    call_rcu(&itable.rcu, ifree);
+  }
   release(&itable.lock);
-  return ip;
+}
+
+// take ip, whose last reference is gone, off its hash chain,
+// and reuse it once lock-free searches can no longer be
+// looking at it. itable.lock must be held.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  // leave ip->hnext alone for searches on their way
+  // through ip.
+  for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+    ;
+  __atomic_store_n(pp, ip->hnext, __ATOMIC_RELEASE);
+
+  if(itable.dying){
+    ip->nextfree = itable.dead;
+    itable.dead = ip;
+  } else {
+    ip->nextfree = 0;
+    itable.dying = ip;
+    call_rcu(&itable.rcu, ifree);
+  }
+}
+
+int
+inodestats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "iget: %lu lock-free, %lu locked, %lu waited for a grace period\n",
+                  istats.nfast, istats.nslow, istats.nwait);
 }
 
 // Lock the given inode.
@@ -322,6 +428,37 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode shared with other readers, for code
+// that only examines it and its content, such as readi(),
+// stati() and dirlookup().
+// Reads the inode from disk if necessary, which takes the
+// lock exclusive for a moment.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  if(ip->valid == 0){
+    // the caller's reference keeps it valid once loaded.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+// Unlock an inode locked with ilockshared().
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || !heldshared(&ip->lock) || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode table entry can
 // be recycled.
@@ -353,7 +490,9 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  // a lock-free iget() may be adding a reference meanwhile.
+  if(__sync_sub_and_fetch(&ip->ref, 1) == 0)
+    iunhash(ip);
   release(&itable.lock);
 }
 
@@ -629,28 +768,39 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  struct proc *l;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    // another thread may be in chdir().
+    l = myproc()->leader;
+    acquire(&l->glock);
+    ip = idup(l->cwd);
+    release(&l->glock);
+  }
 
+  // lookups only read each directory, so they can
+  // share it with others.
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlockshared(ip);
+    iput(ip);
     ip = next;
   }
   if(nameiparent){
@@ -0,0 +1,185 @@
+//
+// futexes: let user threads sleep until a word of user
+// memory changes, for mutexes and condition variables
+// built in user space.
+//
+// a futex is named by the physical address of the word,
+// so that it is the same futex in every mapping of the page.
+// waiters queue in FIFO order on a hashed bucket, and each
+// sleeps on its own queue entry, so futex_wake() can wake
+// exactly the number asked for.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define NBUCKET 31
+
+struct waiter {
+  uint64 key;           // physical address of the futex word
+  int woken;            // by futex_wake()
+  int timedout;
+  struct bucket *b;
+  struct waiter *next;
+};
+
+struct bucket {
+  struct spinlock lock;
+  struct waiter *head;
+};
+
+static struct bucket buckets[NBUCKET];
+
+// updated atomically, since each bucket has its own lock.
+static struct {
+  uint64 nwait;         // futex_wait() calls that slept
+  uint64 nagain;        // that found the word already changed
+  uint64 nwake;         // futex_wake() calls
+  uint64 nwoken;        // waiters they woke
+  uint64 ntimeout;
+} fstats;
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NBUCKET; i++)
+    initlock(&buckets[i].lock, "futex");
+}
+
+// the physical address of the futex word at user va,
+// or 0 if it isn't mapped or isn't aligned.
+static uint64
+futexkey(uint64 va)
+{
+  uint64 pa;
+
+  if(va % sizeof(int))
+    return 0;
+  if((pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(va))) == 0)
+    return 0;
+  return pa + (va - PGROUNDDOWN(va));
+}
+
+static struct bucket*
+hash(uint64 key)
+{
+  return &buckets[(key / sizeof(int)) % NBUCKET];
+}
+
+// remove w from its bucket's queue, if it is still there.
+static void
+dequeue(struct waiter *w)
+{
+  struct waiter **pp;
+
+  for(pp = &w->b->head; *pp; pp = &(*pp)->next){
+    if(*pp == w){
+      *pp = w->next;
+      return;
+    }
+  }
+}
+
+static void
+futextimeout(void *arg)
+{
+  struct waiter *w = arg;
+
+  acquire(&w->b->lock);
+  w->timedout = 1;
+  wakeup(w);
+  release(&w->b->lock);
+}
+
+// if the int at user address va still holds val, sleep until
+// futex_wake(), or until mtime reaches deadline if it is not 0.
+// returns 0 if woken by futex_wake(), -1 otherwise.
+int
+futex_wait(uint64 va, int val, uint64 deadline)
+{
+  struct waiter w, **pp;
+  struct timer t;
+  struct proc *p = myproc();
+
+  if((w.key = futexkey(va)) == 0)
+    return -1;
+  w.b = hash(w.key);
+  w.woken = 0;
+  w.timedout = 0;
+  w.next = 0;
+
+  acquire(&w.b->lock);
+  // futex_wake() holds the same lock, so a waker that
+  // changed the word can't slip in before we're queued.
+  if(*(volatile int *)w.key != val){
+    __sync_fetch_and_add(&fstats.nagain, 1);
+    release(&w.b->lock);
+    return -1;
+  }
+  for(pp = &w.b->head; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+  __sync_fetch_and_add(&fstats.nwait, 1);
+
+  if(deadline)
+    hrtimer_add(&t, deadline, futextimeout, &w);
+
+  while(!w.woken && !w.timedout && !p->killed)
+    sleep(&w, &w.b->lock);
+  if(!w.woken)
+    dequeue(&w);
+  if(w.timedout)
+    __sync_fetch_and_add(&fstats.ntimeout, 1);
+  release(&w.b->lock);
+
+  // futextimeout() uses w, so it must be done before w goes away.
+  if(deadline)
+    timer_del_sync(&t);
+
+  return w.woken ? 0 : -1;
+}
+
+// wake up to n threads waiting on the futex at user va,
+// oldest first. returns the number woken.
+int
+futex_wake(uint64 va, int n)
+{
+  uint64 key;
+  struct bucket *b;
+  struct waiter *w, **pp;
+  int woken = 0;
+
+  if((key = futexkey(va)) == 0)
+    return -1;
+  b = hash(key);
+
+  acquire(&b->lock);
+  __sync_fetch_and_add(&fstats.nwake, 1);
+  for(pp = &b->head; (w = *pp) != 0 && woken < n; ){
+    if(w->key != key){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  __sync_fetch_and_add(&fstats.nwoken, woken);
+  release(&b->lock);
+  return woken;
+}
+
+int
+futexstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "futex: %lu waits, %lu again, %lu timeouts, %lu wakes, %lu woken\n",
+                  fstats.nwait, fstats.nagain, fstats.ntimeout,
+                  fstats.nwake, fstats.nwoken);
+}
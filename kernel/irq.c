@@ -0,0 +1,274 @@
+//
+// device interrupts. each device's handler is split in two:
+// a top half, called from the trap with interrupts off, that
+// does only what the device needs at once, such as taking
+// its data and acknowledging it; and a bottom half, run
+// as the trap returns with interrupts back on, for the rest,
+// such as waking up the processes waiting for it.
+//
+// each irq goes to the harts in its affinity mask, or, for a
+// device that follows the hart submitting work to it, to
+// that hart, so that completion is handled where the
+// waiter's data is, and the device lock isn't fought over.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NIRQ 32
+
+struct irq {
+  char *name;
+  void (*top)(void);      // with interrupts off
+  void (*bottom)(void);   // later, with interrupts on
+  int follow;             // can follow the submitting hart (irq_follow())
+
+  // irqlock must be held when using these:
+  int affinity;           // harts it goes to, one bit each; 0 to follow
+  int target;             // the hart it follows to
+
+  // updated atomically, since any hart may take an interrupt.
+  uint64 n;               // top halves run
+  uint64 topsum;          // cycles spent in them
+  uint64 topmax;
+  uint64 nbottom;         // bottom halves run
+  uint64 waitmax;         // longest from top half to bottom half
+  uint64 bottommax;       // longest bottom half
+  uint64 nmoved;          // times it followed a new hart
+};
+
+// the console goes to hart 0, and the disk to whichever hart
+// last started a request.
+static struct irq irqs[NIRQ] = {
+  [UART0_IRQ]   { "uart", uartintr, uartbottom, 0, 1 },
+  [VIRTIO0_IRQ] { "virtio", virtio_disk_intr, virtio_disk_bottom, 1, 0 },
+};
+
+static struct spinlock irqlock;
+static int plicharts;     // harts that have set up their PLIC context
+
+// each hart's bottom halves. only that hart uses them,
+// with interrupts off, except as noted.
+static struct {
+  uint pending;           // irqs whose bottom halves are due, one bit each
+  int running;            // in softirq(), with interrupts on
+  uint64 raised[NIRQ];    // when each became pending
+} harts[NCPU];
+
+// a racing hart may lose an update of a maximum,
+// which is tolerable in a statistic.
+static void
+setmax(uint64 *max, uint64 v)
+{
+  if(v > *max)
+    *max = v;
+}
+
+void
+irqinit(void)
+{
+  initlock(&irqlock, "irq");
+}
+
+// the harts irq goes to. irqlock must be held.
+static int
+routed(struct irq *q)
+{
+  return q->affinity ? q->affinity : 1 << q->target;
+}
+
+// tell the PLIC which irqs each hart takes.
+// irqlock must be held.
+static void
+reroute(void)
+{
+  int h, irq;
+  uint bits;
+
+  for(h = 0; h < NCPU; h++){
+    if((plicharts & (1 << h)) == 0)
+      continue;
+    bits = 0;
+    for(irq = 0; irq < NIRQ; irq++)
+      if(irqs[irq].top && (routed(&irqs[irq]) & (1 << h)))
+        bits |= 1 << irq;
+    plic_setenable(h, bits);
+  }
+}
+
+// let the calling hart take the irqs routed to it.
+void
+irqinithart(void)
+{
+  acquire(&irqlock);
+  plicharts |= 1 << cpuid();
+  reroute();
+  release(&irqlock);
+}
+
+// a driver is about to start work on irq's device: if irq
+// follows the submitting hart, route it to this one.
+void
+irq_follow(int irq)
+{
+  struct irq *q = &irqs[irq];
+  int id;
+
+  push_off();
+  id = cpuid();
+  // usually it is already here; check again under the lock.
+  if(q->affinity == 0 && q->target != id){
+    acquire(&irqlock);
+    if(q->affinity == 0 && q->target != id){
+      q->target = id;
+      q->nmoved++;
+      reroute();
+    }
+    release(&irqlock);
+  }
+  pop_off();
+}
+
+// send irq to the harts in mask, or, if mask is 0 and the
+// device can, to the hart that last submitted work to it.
+int
+irqsetaffinity(int irq, int mask)
+{
+  struct irq *q;
+
+  if(irq <= 0 || irq >= NIRQ || irqs[irq].top == 0)
+    return -1;
+  q = &irqs[irq];
+  acquire(&irqlock);
+  mask &= plicharts;
+  if(mask == 0 && !q->follow){
+    release(&irqlock);
+    return -1;
+  }
+  q->affinity = mask;
+  reroute();
+  release(&irqlock);
+  return 0;
+}
+
+// irq's affinity mask; 0 if it follows the submitting hart.
+int
+irqgetaffinity(int irq)
+{
+  int mask;
+
+  if(irq <= 0 || irq >= NIRQ || irqs[irq].top == 0)
+    return -1;
+  acquire(&irqlock);
+  mask = irqs[irq].affinity;
+  release(&irqlock);
+  return mask;
+}
+
+// handle a supervisor external interrupt: ask the PLIC which
+// device interrupted, and run its top half. called from
+// devintr() with interrupts off.
+void
+irqintr(void)
+{
+  struct irq *q;
+  uint64 t0, t;
+  int id = cpuid();
+  int irq = plic_claim();
+
+  if(irq == 0)
+    return;
+  if(irq >= NIRQ || irqs[irq].top == 0){
+    printf("unexpected interrupt irq=%d\n", irq);
+    plic_complete(irq);
+    return;
+  }
+
+  q = &irqs[irq];
+  t0 = timer_now();
+  q->top();
+  if(q->bottom && (harts[id].pending & (1 << irq)) == 0){
+    harts[id].pending |= 1 << irq;
+    harts[id].raised[irq] = t0;
+  }
+  t = timer_now() - t0;
+  __sync_fetch_and_add(&q->n, 1);
+  __sync_fetch_and_add(&q->topsum, t);
+  setmax(&q->topmax, t);
+
+  // the PLIC allows each device to raise at most one
+  // interrupt at a time; tell the PLIC the device is
+  // now allowed to interrupt again.
+  plic_complete(irq);
+}
+
+// is this hart running bottom halves? if so, it must not
+// give up the CPU until they are done. interrupts must be off.
+int
+insoftirq(void)
+{
+  return harts[cpuid()].running;
+}
+
+// run this hart's pending bottom halves with interrupts on,
+// including any that interrupts raise meanwhile. called at
+// the end of a trap, with interrupts off; returns with them
+// off again. does nothing if called from an interrupt that
+// arrived while running them; that caller will see to it.
+void
+softirq(void)
+{
+  int irq, id = cpuid();
+  uint pending;
+  uint64 t0, t;
+  struct irq *q;
+
+  if(harts[id].running || harts[id].pending == 0)
+    return;
+  harts[id].running = 1;
+  while((pending = harts[id].pending) != 0){
+    harts[id].pending = 0;
+    for(irq = 0; irq < NIRQ; irq++){
+      if((pending & (1 << irq)) == 0)
+        continue;
+      q = &irqs[irq];
+      t0 = timer_now();
+      setmax(&q->waitmax, t0 - harts[id].raised[irq]);
+      intr_on();
+      q->bottom();
+      intr_off();
+      t = timer_now() - t0;
+      __sync_fetch_and_add(&q->nbottom, 1);
+      setmax(&q->bottommax, t);
+    }
+  }
+  harts[id].running = 0;
+}
+
+int
+irqstats(char *buf, int sz)
+{
+  struct irq *q;
+  int n = 0;
+  uint64 us = CLINT_FREQ/1000000;
+
+  for(q = irqs; q < &irqs[NIRQ]; q++){
+    if(q->name == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "irq %s: %lu top halves, %lu us avg, %lu us max; "
+                  "%lu bottom halves, %lu us max, after %lu us max wait\n",
+                  q->name, q->n, q->topsum / (q->n ? q->n : 1) / us, q->topmax / us,
+                  q->nbottom, q->bottommax / us, q->waitmax / us);
+    if(q->affinity)
+      n += snprintf(buf+n, sz-n, "irq %s: harts %x\n", q->name, q->affinity);
+    else
+      n += snprintf(buf+n, sz-n, "irq %s: follows submitter, now hart %d, moved %lu times\n",
+                    q->name, q->target, q->nmoved);
+  }
+  return n;
+}
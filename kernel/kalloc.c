@@ -23,10 +23,30 @@ struct {
   struct run *freelist;
 } kmem;
 
+// caches that give back memory when kalloc() runs out.
+#define NSHRINKER 4
+#define SHRINKBATCH 8   // pages to ask for at a time
+
+static int (*shrinkers[NSHRINKER])(int);
+static int nshrinker;
+
+// have kalloc(), when it runs out of memory, call fn(n) to
+// free about n pages that a cache can spare. fn must not
+// sleep or call kalloc(), and returns how many it freed.
+void
+kshrinker(int (*fn)(int))
+{
+  acquire(&kmem.lock);
+  if(nshrinker == NSHRINKER)
+    panic("kshrinker");
+  shrinkers[nshrinker++] = fn;
+  release(&kmem.lock);
+}
+
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  initlockkind(&kmem.lock, "kmem", LOCK_MCS);
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -62,11 +82,13 @@ kfree(void *pa)
   release(&kmem.lock);
 }
 
-// Allocate one 4096-byte page of physical memory.
+// Allocate one 4096-byte page of physical memory, without
+// asking caches to shrink, for a cache that grows out of
+// memory no one else wants.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 void *
-kalloc(void)
+kalloc_noreclaim(void)
 {
   struct run *r;
 
@@ -80,3 +102,23 @@ kalloc(void)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Allocate one 4096-byte page of physical memory,
+// shrinking caches if there is none free.
+// Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc(void)
+{
+  void *pa;
+  int i, freed;
+
+  while((pa = kalloc_noreclaim()) == 0){
+    freed = 0;
+    for(i = 0; i < nshrinker; i++)
+      freed += shrinkers[i](SHRINKBATCH);
+    if(freed == 0)
+      break;
+  }
+  return pa;
+}
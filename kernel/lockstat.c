@@ -0,0 +1,161 @@
+//
+// the lockstat device: read it for a profile of the kernel's
+// locks, one line per lock name, most contended first;
+// write anything to it to zero the counters.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ (NLOCKCLASS*96)
+
+static struct lockclass classes[NLOCKCLASS];
+static int nclass;
+// guards adding to classes[]. not a spinlock, since
+// initlock() calls lockclass().
+static uint registering;
+
+static struct {
+  struct spinlock lock;
+  char buf[BUFSZ];
+  int sz;
+  int off;
+} dump;
+
+// the class for locks named name, adding it if need be.
+// returns 0 if the table is full.
+struct lockclass*
+lockclass(char *name, int sleep)
+{
+  struct lockclass *lc;
+
+  push_off();
+  while(__sync_lock_test_and_set(&registering, 1) != 0)
+    ;
+  for(lc = classes; lc < &classes[nclass]; lc++)
+    if(lc->sleep == sleep && strncmp(lc->name, name, 32) == 0)
+      goto found;
+  if(nclass == NLOCKCLASS){
+    lc = 0;
+    goto found;
+  }
+  lc = &classes[nclass];
+  lc->name = name;
+  lc->sleep = sleep;
+  // make the new class complete before a racing
+  // initlock() can find it.
+  __sync_synchronize();
+  nclass++;
+found:
+  __sync_lock_release(&registering);
+  pop_off();
+  return lc;
+}
+
+struct total {
+  struct lockclass *lc;
+  uint64 nacquire;
+  uint64 ncontended;
+  uint64 nspin;
+  uint64 hold;
+};
+
+static void
+sum(struct lockclass *lc, struct total *t)
+{
+  t->lc = lc;
+  t->nacquire = t->ncontended = t->nspin = t->hold = 0;
+  for(int i = 0; i < NCPU; i++){
+    t->nacquire += lc->cpu[i].nacquire;
+    t->ncontended += lc->cpu[i].ncontended;
+    t->nspin += lc->cpu[i].nspin;
+    t->hold += lc->cpu[i].hold;
+  }
+}
+
+// format every class that has been acquired, most
+// contended first, into dump.buf.
+static int
+format(void)
+{
+  static struct total t[NLOCKCLASS];
+  struct total tmp;
+  int i, j, n, sz;
+
+  n = 0;
+  for(i = 0; i < nclass; i++){
+    sum(&classes[i], &t[n]);
+    if(t[n].nacquire == 0)
+      continue;
+    for(j = n; j > 0 && t[j-1].ncontended < t[j].ncontended; j--){
+      tmp = t[j];
+      t[j] = t[j-1];
+      t[j-1] = tmp;
+    }
+    n++;
+  }
+
+  sz = snprintf(dump.buf, BUFSZ, "%s %s %s %s %s %s\n",
+                "name", "kind", "acquires", "contended", "spins/sleeps", "avg-hold");
+  for(i = 0; i < n; i++){
+    sz += snprintf(dump.buf+sz, BUFSZ-sz, "%s %s %lu %lu %lu %lu%s\n",
+                   t[i].lc->name, t[i].lc->sleep ? "sleep" : "spin",
+                   t[i].nacquire, t[i].ncontended, t[i].nspin,
+                   t[i].lc->sleep ? t[i].hold / t[i].nacquire / (CLINT_FREQ/1000000)
+                                  : t[i].hold / t[i].nacquire,
+                   t[i].lc->sleep ? "us" : "cyc");
+  }
+  return sz;
+}
+
+// the first read of a dump formats it; subsequent reads
+// return the rest of it, and then end-of-file, after which
+// the next read starts over.
+int
+lockstatread(int user_dst, uint64 dst, int n)
+{
+  int m;
+
+  acquire(&dump.lock);
+  if(dump.sz == 0)
+    dump.sz = format();
+  m = dump.sz - dump.off;
+  if(m > 0){
+    if(m > n)
+      m = n;
+    if(either_copyout(user_dst, dst, dump.buf+dump.off, m) != -1)
+      dump.off += m;
+  } else {
+    m = 0;
+    dump.sz = 0;
+    dump.off = 0;
+  }
+  release(&dump.lock);
+  return m;
+}
+
+// zero all the counters. a lock held meanwhile may count
+// its hold time from before the reset.
+int
+lockstatwrite(int user_src, uint64 src, int n)
+{
+  for(int i = 0; i < nclass; i++)
+    memset(classes[i].cpu, 0, sizeof(classes[i].cpu));
+  return n;
+}
+
+void
+lockstatinit(void)
+{
+  initlock(&dump.lock, "lockstat");
+
+  devsw[LOCKSTAT].read = lockstatread;
+  devsw[LOCKSTAT].write = lockstatwrite;
+}
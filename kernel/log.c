@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "waitqueue.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -45,6 +46,7 @@ struct log {
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
+  struct waitqueue wq; // begin_op()s waiting for the above
 };
 struct log log;
 
@@ -57,7 +59,8 @@ initlog(int dev, struct superblock *sb)
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
-  initlock(&log.lock, "log");
+  initlockkind(&log.lock, "log", LOCK_TICKET);
+  init_waitqueue(&log.wq, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
@@ -126,15 +129,23 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  struct waitentry w;
+
+  // woken one at a time as end_op()s free up space,
+  // but all together when a commit finishes.
+  init_waitentry(&w, 1);
   acquire(&log.lock);
   while(1){
     if(log.committing){
-      sleep(&log, &log.lock);
+      wait_on(&log.wq, &w, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      wait_on(&log.wq, &w, &log.lock);
     } else {
       log.outstanding += 1;
+      // if there's room for another op, let the next waiter in.
+      if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS <= LOGSIZE)
+        wake_one(&log.wq);
       release(&log.lock);
       break;
     }
@@ -158,8 +169,8 @@ end_op(void)
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+    // the amount of reserved space, by enough for one.
+    wake_one(&log.wq);
   }
   release(&log.lock);
 
@@ -169,7 +180,7 @@ end_op(void)
     commit();
     acquire(&log.lock);
     log.committing = 0;
-    wakeup(&log);
+    wake_all(&log.wq);
     release(&log.lock);
   }
 }
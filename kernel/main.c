@@ -22,11 +22,19 @@ main()
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
+    wheelinit();     // kernel timers
+    rcuinit();       // read-copy-update
+    waitqueueinit(); // wait queue counters
+    timerinithart(); // one-shot clock interrupts
     plicinit();      // set up interrupt controller
+    irqinit();       // device interrupt routing
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    futexinit();     // futex wait queues
+    statsinit();     // statistics device
+    lockstatinit();  // lock profile device
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -38,8 +46,11 @@ main()
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
+    timerinithart();  // one-shot clock interrupts
     plicinithart();   // ask PLIC for device interrupts
   }
 
+  reaperinit();       // this hart's address space reaper
+  workqueueinit();    // and its worker thread
   scheduler();        
 }
@@ -25,10 +25,13 @@
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
 
-// core local interruptor (CLINT), which contains the timer.
+// core local interruptor (CLINT), which contains the timer,
+// and a software interrupt that any hart may raise in another.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define CLINT_FREQ 10000000 // mtime cycles per second in qemu.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -62,6 +65,28 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   THREADFRAMEs (trapframes of threads other than the leader)
+//   USYSCALL (p->usyscall, read-only, shared with the kernel)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USYSCALL (TRAPFRAME - PGSIZE)
+
+// the trapframes of a process's other threads go below
+// USYSCALL, at a page chosen by the thread's p->slot.
+// the heap may not grow past them.
+#define THREADFRAME(i) (USYSCALL - ((i)+1)*PGSIZE)
+#define MAXUSZ THREADFRAME(NPROC-1)
+
+// the kernel publishes these in the USYSCALL page so that
+// ulib can answer getpid() and uptime() without a trap.
+// seq is odd while the kernel is updating the page; a reader
+// retries if it sees an odd seq, or seq changes under it.
+// the current tick is ticks + (time CSR - base) / interval.
+struct usyscall {
+  uint seq;
+  int pid;
+  uint ticks;    // clock ticks since boot, as of base
+  uint64 base;   // mtime at which ticks began
+  uint64 interval; // mtime cycles per tick
+};
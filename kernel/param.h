@@ -1,5 +1,9 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC       512  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define ALLHARTS     ((1<<NCPU)-1)  // affinity mask allowing any CPU
+#define NMCS          8  // MCS spinlocks one CPU may hold at once
+#define NPRIO         8  // scheduling priorities; 0 is the most urgent
+#define DEFPRIO       4  // priority of a new process
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -8,6 +12,8 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUFMIN      (MAXOPBLOCKS*3)  // disk block cache size it never shrinks below
+#define NBUFMAX      1024  // and never grows past
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICKINTERVAL 1000000 // cycles per clock tick; about 1/10th second in qemu
@@ -7,6 +7,7 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "waitqueue.h"
 
 #define PIPESIZE 512
 
@@ -17,8 +18,23 @@ struct pipe {
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  struct waitqueue readers; // waiting for data
+  struct waitqueue writers; // waiting for space
 };
 
+// readers and writers wait exclusively, so data or space
+// wakes one of them; then, so that none is left asleep while
+// there is something for it, whoever is done with the pipe
+// wakes the next, if there is still data or space left.
+static void
+passon(struct pipe *pi)
+{
+  if(pi->nread != pi->nwrite)
+    wake_one(&pi->readers);
+  if(pi->nwrite != pi->nread + PIPESIZE)
+    wake_one(&pi->writers);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -35,6 +51,9 @@ pipealloc(struct file **f0, struct file **f1)
   pi->nwrite = 0;
   pi->nread = 0;
   initlock(&pi->lock, "pipe");
+  init_waitqueue(&pi->readers, "pipe read");
+  init_waitqueue(&pi->writers, "pipe write");
+  pi->readers.affine = pi->writers.affine = 1;
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -61,10 +80,10 @@ pipeclose(struct pipe *pi, int writable)
   acquire(&pi->lock);
   if(writable){
     pi->writeopen = 0;
-    wakeup(&pi->nread);
+    wake_all(&pi->readers);
   } else {
     pi->readopen = 0;
-    wakeup(&pi->nwrite);
+    wake_all(&pi->writers);
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
@@ -78,16 +97,20 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 {
   int i = 0;
   struct proc *pr = myproc();
+  struct waitentry w;
 
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || pr->killed){
+      passon(pi);
       release(&pi->lock);
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
+      passon(pi);
+      init_waitentry(&w, 1);
+      while(pi->nwrite == pi->nread + PIPESIZE && pi->readopen && !pr->killed)
+        wait_on(&pi->writers, &w, &pi->lock);
     } else {
       char ch;
       if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
@@ -96,7 +119,7 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       i++;
     }
   }
-  wakeup(&pi->nread);
+  passon(pi);
   release(&pi->lock);
 
   return i;
@@ -107,15 +130,18 @@ piperead(struct pipe *pi, uint64 addr, int n)
 {
   int i;
   struct proc *pr = myproc();
+  struct waitentry w;
   char ch;
 
+  init_waitentry(&w, 1);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(pr->killed){
+      passon(pi);
       release(&pi->lock);
       return -1;
     }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    wait_on(&pi->readers, &w, &pi->lock); //DOC: piperead-sleep
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
@@ -124,7 +150,7 @@ piperead(struct pipe *pi, uint64 addr, int n)
     if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
       break;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  passon(pi);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
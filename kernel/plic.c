@@ -21,11 +21,18 @@ plicinithart(void)
 {
   int hart = cpuid();
   
-  // set uart's enable bit for this hart's S-mode. 
-  *(uint32*)PLIC_SENABLE(hart)= (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
-
   // set this hart's S-mode priority threshold to 0.
   *(uint32*)PLIC_SPRIORITY(hart) = 0;
+
+  // enable the irqs routed to this hart (irq.c).
+  irqinithart();
+}
+
+// let hart take the irqs in bits, one bit each.
+void
+plic_setenable(int hart, uint bits)
+{
+  *(uint32*)PLIC_SENABLE(hart) = bits;
 }
 
 // ask the PLIC what interrupt we should serve.
@@ -4,21 +4,103 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// the proc table grows a page of procs at a time, up to
+// NPROC, as allocproc() runs out of free ones. procs are
+// never freed back to kalloc(), so a struct proc pointer
+// stays valid even after the process it named is gone.
+#define PROCPERPAGE (PGSIZE / sizeof(struct proc))
+#define NPIDHASH (NPROC/4)
+
+struct proc *procs[NPROC];  // the proc in each slot
+static int nproc;           // slots in use; only grows
+
+// guards the free list, the pid hash, and growing the table.
+// acquired after any p->lock.
+static struct spinlock ptable_lock;
+static struct proc *freelist;
+static struct proc *pidhash[NPIDHASH];
 
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// harts that have reached scheduler(), one bit each.
+int onlineharts;
+
+// harts waiting in idle() for something to run, one bit each.
+int idleharts;
+
+// how long, in cycles, a woken process is held for the hart
+// that woke it before other harts may run it.
+#define AFFINEWINDOW (TICKINTERVAL/100)
+
+// guards processes' priorities, what they are blocked on,
+// and which sleeplocks lend them priority, and, for sleeplocks
+// someone is asleep waiting for, their owners and sleepers'
+// priorities. only taken when a sleeplock is contended, or
+// a priority set. acquired after any p->lock or sleeplock's lk.
+static struct spinlock pilock;
+
+// how far along a chain of blocked processes
+// priority is passed.
+#define PIDEPTH 8
+
+static struct {
+  uint64 nboost;    // priorities lent to sleeplock holders,
+  uint64 nchained;  // and passed along to what they are blocked on
+} pistats;
+
+static struct {
+  uint64 naffine;   // wakeups placed on the waker's hart
+  uint64 nhandoff;  // of those, run there next
+  uint64 nstolen;   // run elsewhere after the window
+  uint64 nrun;      // times a RUNNABLE process was run,
+  uint64 waitsum;   // the cycles they waited to run,
+  uint64 waitmax;   // and the longest such wait.
+} sstats;
+
+// wake a hart waiting in idle() that may run p, if there
+// is one. pairs with idle(): either this sees the hart's bit
+// in idleharts, or idle() sees p RUNNABLE.
+static void
+kick(struct proc *p)
+{
+  int mask, id;
+
+  __sync_synchronize();
+  mask = __atomic_load_n(&idleharts, __ATOMIC_RELAXED) & p->affinity;
+  if(mask == 0)
+    return;
+  for(id = 0; (mask & (1 << id)) == 0; id++)
+    ;
+  // another waker may have kicked it already.
+  if(__sync_fetch_and_and(&idleharts, ~(1 << id)) & (1 << id))
+    timer_kick(id);
+}
+
+// p can run. p->lock must be held. unless p is the caller,
+// whose hart is about to look for something to run anyway,
+// wake a hart that may run it.
+static void
+ready(struct proc *p)
+{
+  p->state = RUNNABLE;
+  p->readyat = timer_now();
+  if(p != myproc())
+    kick(p);
+}
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
+extern pagetable_t kernel_pagetable; // vm.c
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
@@ -26,34 +108,63 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl) {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+// the number of slots in the proc table. procs[i] is
+// set for every i below it.
+static int
+tablesize(void)
+{
+  return __atomic_load_n(&nproc, __ATOMIC_ACQUIRE);
+}
+
+// Add a page of procs to the table, each with a kernel
+// stack mapped high in memory, followed by an invalid
+// guard page, and put them on the free list.
+// Returns 0 if the table is full or memory is short.
+// Caller must hold ptable_lock.
+static int
+growtable(void)
+{
+  struct proc *page, *p;
+  char *stack;
+  int n = nproc;
+
+  if(n >= NPROC || (page = (struct proc *)kalloc()) == 0)
+    return 0;
+  memset(page, 0, PGSIZE);
+  for(p = page; p < page + PROCPERPAGE && n < NPROC; p++, n++){
+    if((stack = kalloc()) == 0)
+      break;
+    if(mappages(kernel_pagetable, KSTACK(n), PGSIZE, (uint64)stack, PTE_R | PTE_W) < 0){
+      kfree(stack);
+      break;
+    }
+    initlock(&p->lock, "proc");
+    initlock(&p->glock, "group");
+    p->slot = n;
+    p->kstack = KSTACK(n);
+    p->nextfree = freelist;
+    freelist = p;
+    procs[n] = p;
+  }
+  if(p == page){
+    kfree(page);
+    return 0;
   }
+  // other harts fence before they first run on these
+  // stacks; see run().
+  sfence_vma();
+  __atomic_store_n(&nproc, n, __ATOMIC_RELEASE);
+  return 1;
 }
 
 // initialize the proc table at boot time.
 void
 procinit(void)
 {
-  struct proc *p;
-  
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  initlock(&ptable_lock, "ptable");
+  initlock(&pilock, "pi");
 }
 
 // Must be called with interrupts disabled,
@@ -97,35 +208,136 @@ allocpid() {
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// the unlocked proc with the given pid, or 0.
+// Caller must hold ptable_lock.
+static struct proc*
+hashlookup(int pid)
+{
+  struct proc *p;
+
+  for(p = pidhash[(uint)pid % NPIDHASH]; p; p = p->hashnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Look up the process with the given pid.
+// If found, return it with p->lock held, otherwise 0.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  acquire(&ptable_lock);
+  p = hashlookup(pid);
+  release(&ptable_lock);
+  if(p == 0)
+    return 0;
+
+  // p->lock comes before ptable_lock, so p may have been
+  // freed and reused in between; pids are never reused.
+  acquire(&p->lock);
+  if(p->pid != pid || p->state == UNUSED){
+    release(&p->lock);
+    return 0;
+  }
+  return p;
+}
+
+// Take an UNUSED proc from the free list, growing the
+// table if the list is empty, and give it a pid.
+// Returns it with p->lock held, or 0 if there are none.
+static struct proc*
+getproc(void)
+{
+  int pid;
+  struct proc *p;
+
+  pid = allocpid();
+  acquire(&ptable_lock);
+  if(freelist == 0 && growtable() == 0){
+    release(&ptable_lock);
+    return 0;
+  }
+  p = freelist;
+  freelist = p->nextfree;
+  p->nextfree = 0;
+  release(&ptable_lock);
+
+  acquire(&p->lock);
+  if(p->state != UNUSED)
+    panic("allocproc");
+
+  acquire(&ptable_lock);
+  p->pid = pid;
+  p->hashnext = pidhash[(uint)pid % NPIDHASH];
+  pidhash[(uint)pid % NPIDHASH] = p;
+  release(&ptable_lock);
+  p->state = USED;
+  p->leader = p;
+  p->affinity = ALLHARTS;
+  p->baseprio = p->prio = DEFPRIO;
+  p->blockedon = 0;
+  p->lent = 0;
+  p->wakecpu = -1;
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.sp = p->kstack + PGSIZE;
+
+  return p;
+}
+
+// Look for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
+// If leader is non-zero, the new proc is a thread in
+// leader's group, sharing its page table.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc*
-allocproc(void)
+allocproc(struct proc *leader)
 {
+  int r;
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
+  if((p = getproc()) == 0)
+    return 0;
+  if(leader)
+    p->leader = leader;
+
+  // Allocate a trapframe page.
+  if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
+  if(leader){
+    // map the thread's trapframe into the shared page table,
+    // at a page no other thread in the group can be using.
+    p->pagetable = leader->pagetable;
+    p->usyscall = leader->usyscall;
+    acquire(&leader->glock);
+    r = mappages(p->pagetable, THREADFRAME(p->slot), PGSIZE,
+                 (uint64)(p->trapframe), PTE_R | PTE_W);
+    release(&leader->glock);
+    if(r < 0){
+      freeproc(p);
       release(&p->lock);
+      return 0;
     }
+    p->tfva = THREADFRAME(p->slot);
+    goto context;
   }
-  return 0;
-
-found:
-  p->pid = allocpid();
-  p->state = USED;
+  p->tfva = TRAPFRAME;
+  p->nthread = 1;
 
-  // Allocate a trapframe page.
-  if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+  // Allocate the page ulib reads the pid and clock from.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
     freeproc(p);
     release(&p->lock);
     return 0;
   }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
 
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
@@ -135,35 +347,131 @@ found:
     return 0;
   }
 
+context:
   // Set up new context to start executing at forkret,
   // which returns to user space.
-  memset(&p->context, 0, sizeof(p->context));
   p->context.ra = (uint64)forkret;
-  p->context.sp = p->kstack + PGSIZE;
 
   return p;
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn(p->karg);
+  panic("kthread return");
+}
+
+// Start a thread, named name, that runs fn(arg) in the kernel
+// on the harts in affinity. It has no user memory, and can't
+// be killed. It runs at priority 0, so that no process can
+// keep the work it does for everyone from running. fn must
+// not return.
+// Returns the new thread, or 0 if there are no free procs.
+struct proc*
+kthread(char *name, void (*fn)(void*), void *arg, int affinity)
+{
+  struct proc *p;
+
+  if((p = getproc()) == 0)
+    return 0;
+  p->kfn = fn;
+  p->karg = arg;
+  p->affinity = affinity;
+  p->baseprio = p->prio = 0;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->context.ra = (uint64)kthreadret;
+  ready(p);
+  release(&p->lock);
+  return p;
+}
+
+// add p to the front of a children or threads list.
+// Caller must hold wait_lock.
+static void
+listadd(struct proc **head, struct proc *p)
+{
+  p->sibling = *head;
+  if(*head)
+    (*head)->psibling = &p->sibling;
+  *head = p;
+  p->psibling = head;
+}
+
+// remove p from whichever list it is on.
+// Caller must hold wait_lock.
+static void
+listdel(struct proc *p)
+{
+  *p->psibling = p->sibling;
+  if(p->sibling)
+    p->sibling->psibling = p->psibling;
+  p->sibling = 0;
+  p->psibling = 0;
+}
+
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including user pages, and put it on the free list.
+// p->lock must be held, and wait_lock too if p is
+// on a children or threads list.
 static void
 freeproc(struct proc *p)
 {
+  struct proc **pp;
+
+  if(p->leader && p->leader != p){
+    // a thread owns only its trapframe; the rest is the leader's.
+    if(p->tfva){
+      acquire(&p->leader->glock);
+      uvmunmap(p->pagetable, p->tfva, 1, 0);
+      release(&p->leader->glock);
+    }
+    p->pagetable = 0;
+    p->usyscall = 0;
+  }
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
+  if(p->psibling)
+    listdel(p);
+  p->affinity = 0;
   p->parent = 0;
+  p->leader = 0;
+  p->nthread = 0;
+  p->tfva = 0;
+  p->kfn = 0;
+  p->karg = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+
+  acquire(&ptable_lock);
+  if(p->pid){
+    for(pp = &pidhash[(uint)p->pid % NPIDHASH]; *pp != p; pp = &(*pp)->hashnext)
+      ;
+    *pp = p->hashnext;
+    p->hashnext = 0;
+    p->pid = 0;
+  }
+  p->nextfree = freelist;
+  freelist = p;
+  release(&ptable_lock);
 }
 
 // Create a user page table for a given process,
@@ -196,6 +504,16 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the usyscall page below the trapframe, readable
+  // but not writable by user code.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -206,6 +524,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -227,7 +546,7 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy init's instructions
@@ -242,29 +561,76 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  ready(p);
 
   release(&p->lock);
 }
 
+// growproc() maps memory this much at a time, so that
+// a timer interrupt can preempt it in between.
+#define GROWCHUNK (64*PGSIZE)
+
 // Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
+// Return the old size, or -1 on failure.
+uint64
 growproc(int n)
 {
-  uint sz;
-  struct proc *p = myproc();
-
-  sz = p->sz;
+  uint64 sz, oldsz, end;
+  int r;
+  struct proc *l = myproc()->leader;
+
+  acquire(&l->glock);
+  // one thread grows memory at a time, so each gets a
+  // contiguous range.
+  while(l->growing)
+    sleep(&l->growing, &l->glock);
+  sz = oldsz = l->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz + n > MAXUSZ){
+      release(&l->glock);
+      return -1;
+    }
+    l->growing = 1;
+    while(sz < oldsz + n){
+      end = sz + GROWCHUNK < oldsz + n ? sz + GROWCHUNK : oldsz + n;
+      if(uvmalloc(l->pagetable, sz, end) == 0){
+        // exited processes' memory may still be on its way
+        // back to kalloc(); if so, wait for it and try again.
+        release(&l->glock);
+        r = reapwait();
+        acquire(&l->glock);
+        if(r)
+          continue;
+        uvmdealloc(l->pagetable, sz, oldsz);
+        break;
+      }
+      sz = end;
+      // let interrupts in.
+      release(&l->glock);
+      acquire(&l->glock);
+    }
+    l->growing = 0;
+    if(sz < oldsz + n){
+      release(&l->glock);
+      wakeup(&l->growing);
       return -1;
     }
+    l->sz = sz;
+    release(&l->glock);
+    wakeup(&l->growing);
+    return oldsz;
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    // another thread could be in copyin() or copyout()
+    // on the pages being freed.
+    if(l->nthread > 1){
+      release(&l->glock);
+      return -1;
+    }
+    sz = uvmdealloc(l->pagetable, sz, sz + n);
   }
-  p->sz = sz;
-  return 0;
+  l->sz = sz;
+  release(&l->glock);
+  return oldsz;
 }
 
 // Create a new process, copying the parent.
@@ -275,19 +641,31 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *p = myproc();
+  struct proc *l = p->leader;
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
+  // nothing else uses np until it is RUNNABLE. don't hold its
+  // lock while copying, so that a big copy can be preempted.
+  release(&np->lock);
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child. other threads can
+  // grow it meanwhile, but not shrink it, so the pages below
+  // the size when we start stay put.
+  acquire(&l->glock);
+  np->sz = l->sz;
+  release(&l->glock);
+  while(uvmcopy(l->pagetable, np->pagetable, np->sz) < 0){
+    // as in growproc(), memory may be on its way back.
+    if(reapwait())
+      continue;
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -296,23 +674,28 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
+  acquire(&l->glock);
   for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+    if(l->ofile[i])
+      np->ofile[i] = filedup(l->ofile[i]);
+  np->cwd = idup(l->cwd);
+  release(&l->glock);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
-  pid = np->pid;
+  np->affinity = p->affinity;
+  np->baseprio = np->prio = p->baseprio;
 
-  release(&np->lock);
+  pid = np->pid;
 
+  // the child belongs to the whole group, not just this thread.
   acquire(&wait_lock);
-  np->parent = p;
+  np->parent = l;
+  listadd(&l->children, np);
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  ready(np);
   release(&np->lock);
 
   return pid;
@@ -325,25 +708,209 @@ reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+  if(p->children == 0)
+    return;
+  while((pp = p->children) != 0){
+    listdel(pp);
+    pp->parent = initproc;
+    listadd(&initproc->children, pp);
+  }
+  wakeup(initproc);
+}
+
+// Create a thread in the current process, sharing its
+// memory, open files and current directory, that starts
+// by calling fn(arg) on the user stack whose top is sp.
+// Returns the new thread's id.
+int
+clone(uint64 fn, uint64 arg, uint64 sp)
+{
+  int tid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  if((np = allocproc(l)) == 0){
+    return -1;
+  }
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = sp;
+  np->trapframe->ra = 0; // fn must call exit() rather than return
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  np->affinity = p->affinity;
+  np->baseprio = np->prio = p->baseprio;
+
+  tid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  l->nthread++;
+  listadd(&l->threads, np);
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  ready(np);
+  release(&np->lock);
+
+  return tid;
+}
+
+// Free l's exited threads, and if kill is set, kill the rest.
+// Returns the number of threads, other than l, still running.
+// Caller must hold wait_lock.
+static int
+reapthreads(struct proc *l, int kill)
+{
+  struct proc *np, *next;
+  int n = 0;
+
+  for(np = l->threads; np; np = next){
+    next = np->sibling;
+    acquire(&np->lock);
+    if(np->state == ZOMBIE){
+      freeproc(np);
+    } else {
+      n++;
+      if(kill){
+        np->killed = 1;
+        if(np->state == SLEEPING)
+          ready(np);
+      }
+    }
+    release(&np->lock);
+  }
+  return n;
+}
+
+// Is p the only thread in its process? If so, frees any
+// exited threads, so that the process's address space
+// can be replaced by exec().
+int
+onlythread(struct proc *p)
+{
+  int alone;
+
+  if(p->leader != p)
+    return 0;
+  acquire(&wait_lock);
+  alone = reapthreads(p, 0) == 0;
+  release(&wait_lock);
+  return alone;
+}
+
+// Wait for thread tid of the current process to exit,
+// and return its id. Its exit status goes to addr.
+// Return -1 if there is no such thread.
+int
+join(int tid, uint64 addr)
+{
+  struct proc *np;
+  int found;
+  struct proc *p = myproc();
+  struct proc *l = p->leader;
+
+  acquire(&wait_lock);
+
+  for(;;){
+    found = 0;
+    for(np = l->threads; np; np = np->sibling){
+      if(np == p)
+        continue;
+      acquire(&np->lock);
+      if(np->pid == tid){
+        found = 1;
+        if(np->state == ZOMBIE){
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                  sizeof(np->xstate)) < 0) {
+            release(&np->lock);
+            release(&wait_lock);
+            return -1;
+          }
+          freeproc(np);
+          release(&np->lock);
+          release(&wait_lock);
+          return tid;
+        }
+      }
+      release(&np->lock);
+    }
+
+    if(!found || p->killed){
+      release(&wait_lock);
+      return -1;
     }
+
+    // threads wake their leader when they exit.
+    sleep(l, &wait_lock);
   }
 }
 
+// Exit a thread other than the leader. The rest of the
+// process carries on; the thread's exit status waits
+// in the zombie state for join().
+static void
+exitthread(int status)
+{
+  struct proc *p = myproc();
+
+  acquire(&wait_lock);
+
+  p->leader->nthread--;
+  wakeup(p->leader);
+
+  acquire(&p->lock);
+
+  p->xstate = status;
+  p->state = ZOMBIE;
+
+  release(&wait_lock);
+
+  sched();
+  panic("zombie exit");
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait().
+// Called by a thread other than the leader,
+// exits just that thread.
 void
 exit(int status)
 {
   struct proc *p = myproc();
+  pagetable_t pagetable;
+  uint64 sz;
 
   if(p == initproc)
     panic("init exiting");
 
+  if(p->leader != p)
+    exitthread(status);
+
+  // kill the other threads, and wait for them to be gone,
+  // since they share everything about to be torn down.
+  acquire(&wait_lock);
+  while(reapthreads(p, 1) > 0)
+    sleep(p, &wait_lock);
+  release(&wait_lock);
+
+  // nothing uses the address space now, so let this hart's
+  // reaper free it, rather than making exit() or the
+  // parent's wait() take time in proportion to its size.
+  acquire(&p->glock);
+  pagetable = p->pagetable;
+  sz = p->sz;
+  p->pagetable = 0;
+  p->sz = 0;
+  release(&p->glock);
+  reap(pagetable, sz);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -380,40 +947,39 @@ exit(int status)
 
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Any thread may wait for the children of the process.
 int
 wait(uint64 addr)
 {
   struct proc *np;
   int havekids, pid;
   struct proc *p = myproc();
+  struct proc *l = p->leader;
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
+    // Scan through the children looking for exited ones.
+    havekids = l->children != 0;
+    for(np = l->children; np; np = np->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        freeproc(np);
         release(&np->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -423,8 +989,111 @@ wait(uint64 addr)
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(l, &wait_lock);  //DOC: wait-sleep
+  }
+}
+
+// Switch to p, which is RUNNABLE and locked, and return
+// when it gives up the CPU.
+static void
+run(struct cpu *c, struct proc *p)
+{
+  // It is the process's job to release its lock and then
+  // reacquire it before jumping back to us.
+  uint64 wait = timer_now() - p->readyat;
+
+  // harts racing to raise waitmax may lose an update,
+  // which is tolerable in a statistic.
+  __sync_fetch_and_add(&sstats.nrun, 1);
+  __sync_fetch_and_add(&sstats.waitsum, wait);
+  if(wait > sstats.waitmax)
+    sstats.waitmax = wait;
+
+  // the table may have grown, mapping p's kernel stack,
+  // since this hart last fenced its page table walks.
+  if(p->slot >= c->nproc){
+    sfence_vma();
+    c->nproc = tablesize();
   }
+
+  p->state = RUNNING;
+  p->wakecpu = -1;
+  c->proc = p;
+  timer_slice();
+  swtch(&c->context, &p->context);
+
+  // Process is done running for now.
+  // It should have changed its p->state before coming back.
+  c->proc = 0;
+}
+
+// Is p, woken by a process on another hart, being held
+// for that hart? p->lock must be held.
+static int
+held(struct proc *p, int id)
+{
+  if(p->wakecpu < 0 || p->wakecpu == id)
+    return 0;
+  return timer_now() < p->affineuntil;
+}
+
+// Run the processes that those running on this hart have
+// woken through a pipe, the peer that the waker is about
+// to sleep waiting for, unless they are less urgent than
+// top. Returns 1 if any ran.
+static int
+handoff(struct cpu *c, int me, int top)
+{
+  struct proc *p;
+  int found = 0;
+
+  while((p = __atomic_exchange_n(&c->next, 0, __ATOMIC_ACQUIRE)) != 0){
+    acquire(&p->lock);
+    if(p->state == RUNNABLE && (p->affinity & me) && p->prio <= top){
+      __sync_fetch_and_add(&sstats.nhandoff, 1);
+      run(c, p);
+      found = 1;
+    }
+    release(&p->lock);
+  }
+  return found;
+}
+
+// Is there a RUNNABLE process that hart me may run? looks
+// without taking any p->lock, so may be out of date.
+static int
+runnable(int me)
+{
+  struct proc *p;
+  int i, n = tablesize();
+
+  for(i = 0; i < n; i++){
+    p = procs[i];
+    if(__atomic_load_n(&p->state, __ATOMIC_RELAXED) == RUNNABLE &&
+       (p->affinity & me))
+      return 1;
+  }
+  return 0;
+}
+
+// Nothing for this hart to run: stop its clock tick until a
+// kernel timer is due, and wait for an interrupt, or for
+// kick() from a hart that makes a process RUNNABLE.
+// Returns with interrupts off.
+static void
+idle(int me)
+{
+  intr_off();
+  __sync_fetch_and_or(&idleharts, me);
+  // see startgp() in rcu.c.
+  rcu_qs();
+  // anything made RUNNABLE since the scan and not seen
+  // here will see this hart in idleharts.
+  if(!runnable(me)){
+    timer_idle();
+    wfi();
+  }
+  __sync_fetch_and_and(&idleharts, ~me);
 }
 
 // Per-CPU process scheduler.
@@ -439,28 +1108,48 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  
+  int i, n, found, top, next, id = cpuid(), me = 1 << id;
+
+  top = NPRIO - 1;
   c->proc = 0;
+  __sync_fetch_and_or(&onlineharts, me);
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
+    // run only the most urgent of what this hart can
+    // run, in turn, as of the last pass, and note the most
+    // urgent for the next one. so a process that becomes
+    // RUNNABLE meanwhile waits for the next pass.
+    next = NPRIO;
+    found = handoff(c, me, top);
+    n = tablesize();
+    for(i = 0; i < n; i++) {
+      p = procs[i];
       acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+      if(p->state == RUNNABLE && (p->affinity & me) && !held(p, id)) {
+        if(p->prio <= top){
+          if(p->wakecpu >= 0 && p->wakecpu != id)
+            __sync_fetch_and_add(&sstats.nstolen, 1);
+          run(c, p);
+          found = 1;
+        }
+        // it may be RUNNABLE again after running.
+        if(p->state == RUNNABLE && p->prio < next)
+          next = p->prio;
       }
       release(&p->lock);
+      // between processes, so in a quiescent state.
+      rcu_qs();
+      found |= handoff(c, me, top);
     }
+    top = next < NPRIO ? next : NPRIO - 1;
+
+    // Nothing to run: wait until there may be. if this
+    // pass skipped some for being less urgent than the last
+    // pass found, look again at once.
+    if(!found && next == NPRIO)
+      idle(me);
   }
 }
 
@@ -497,7 +1186,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  ready(p);
   sched();
   release(&p->lock);
 }
@@ -554,19 +1243,61 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// p was just woken by the process running on this hart,
+// which handed it data, such as through a pipe, and will
+// often sleep soon: run p here next, while that data is
+// still in the cache, unless no other hart will have it for
+// AFFINEWINDOW. only for wakeups from process context that
+// say so; a device or timer wakeup has no such tie to
+// whatever it interrupted. p->lock must be held.
+static void
+wakeaffine(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int id = cpuid();
+
+  if(c->proc == 0 || (p->affinity & (1 << id)) == 0)
+    return;
+  p->wakecpu = id;
+  p->affineuntil = timer_now() + AFFINEWINDOW;
+  // an interrupt on this hart could be waking someone too.
+  if(__sync_bool_compare_and_swap(&c->next, 0, p))
+    __sync_fetch_and_add(&sstats.naffine, 1);
+  else
+    p->wakecpu = -1;
+}
+
+// Wake p if it is sleeping on chan, for a caller that
+// knows who is waiting; if affine, the caller is a process
+// handing p data (see wakeaffine()).
+// Must be called without any p->lock.
+void
+wakeproc(struct proc *p, void *chan, int affine)
+{
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan) {
+    // first, so that a hart ready() kicks sees p held.
+    if(affine)
+      wakeaffine(p);
+    ready(p);
+  }
+  release(&p->lock);
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
   struct proc *p;
+  int i, n = tablesize();
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(i = 0; i < n; i++) {
+    p = procs[i];
     if(p != myproc()){
       acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
+      if(p->state == SLEEPING && p->chan == chan)
+        ready(p);
       release(&p->lock);
     }
   }
@@ -580,20 +1311,241 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  if(p->kfn){
+    release(&p->lock);
+    return -1;
+  }
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    ready(p);
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Restrict the thread or process with the given pid, or the
+// caller if pid is 0, to the harts in mask.
+// A process already running elsewhere moves at its next
+// trip through the scheduler; the caller moves at once.
+int
+setaffinity(int pid, int mask)
+{
+  struct proc *p;
+  struct proc *me = myproc();
+
+  mask &= onlineharts;
+  if(mask == 0)
+    return -1;
+  if(pid == 0)
+    pid = me->pid;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  if(p->kfn){
+    // kernel threads stay on the harts they were made for.
+    release(&p->lock);
+    return -1;
+  }
+  p->affinity = mask;
+  if(p->state == RUNNABLE)
+    kick(p);
+  release(&p->lock);
+  if(p == me && (mask & (1 << cpuid())) == 0)
+    yield();
+  return 0;
+}
+
+// The affinity mask of pid, or of the caller if pid is 0.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if(pid == 0)
+    return myproc()->affinity;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->affinity;
+  release(&p->lock);
+  return mask;
+}
+
+// The most urgent priority among lk's sleepers,
+// or NPRIO if none. pilock must be held.
+static int
+waitprio(struct sleeplock *lk)
+{
+  int prio;
+
+  for(prio = 0; prio < NPRIO && lk->sleepers[prio] == 0; prio++)
+    ;
+  return prio;
+}
+
+// The priority p should run at: its own, or that of the
+// most urgent process asleep waiting for a sleeplock p holds.
+// pilock must be held.
+static int
+inherited(struct proc *p)
+{
+  struct sleeplock *lk;
+  int w, prio = p->baseprio;
+
+  for(lk = p->lent; lk; lk = lk->nextlent)
+    if((w = waitprio(lk)) < prio)
+      prio = w;
+  return prio;
+}
+
+// p's priority may have changed: set it again, and pass
+// the change on to the holder of the sleeplock p is blocked
+// on, and along the chain if that holder is blocked too.
+// pilock must be held.
+static void
+repri(struct proc *p)
+{
+  struct sleeplock *lk;
+  int prio, passed = 0;
+
+  for(int depth = 0; p && depth < PIDEPTH; depth++){
+    prio = inherited(p);
+    if(prio == p->prio)
+      break;
+    if(prio < p->prio && prio < p->baseprio){
+      pistats.nboost++;
+      if(passed)
+        pistats.nchained++;
     }
+    if((lk = p->blockedon) != 0){
+      lk->sleepers[p->prio]--;
+      lk->sleepers[prio]++;
+    }
+    passed = prio < p->baseprio;
+    p->prio = prio;
+    p = lk ? lk->owner : 0;
+  }
+}
+
+// add lk to, or take it off, owner's list of sleeplocks
+// whose sleepers lend it priority. pilock must be held.
+static void
+lendfrom(struct proc *owner, struct sleeplock *lk)
+{
+  lk->nextlent = owner->lent;
+  owner->lent = lk;
+}
+
+static void
+unlendfrom(struct proc *owner, struct sleeplock *lk)
+{
+  struct sleeplock **pp;
+
+  for(pp = &owner->lent; *pp != lk; pp = &(*pp)->nextlent)
+    ;
+  *pp = lk->nextlent;
+  lk->nextlent = 0;
+}
+
+// The caller is about to sleep waiting for lk, held by
+// lk->owner, who then runs at least as urgently as the
+// caller until it releases lk. lk->lk must be held.
+void
+piblock(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+
+  acquire(&pilock);
+  p->blockedon = lk;
+  lk->sleepers[p->prio]++;
+  if(lk->nsleeping++ == 0 && lk->owner)
+    lendfrom(lk->owner, lk);
+  if(lk->owner)
+    repri(lk->owner);
+  release(&pilock);
+}
+
+// The caller has woken from waiting for lk, and lends
+// its holder nothing more. lk->lk must be held.
+void
+piunblock(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+
+  acquire(&pilock);
+  p->blockedon = 0;
+  lk->sleepers[p->prio]--;
+  if(--lk->nsleeping == 0 && lk->owner)
+    unlendfrom(lk->owner, lk);
+  if(lk->owner)
+    repri(lk->owner);
+  release(&pilock);
+}
+
+// Make owner, the caller or 0, lk's owner, when someone is
+// asleep waiting for lk: the caller takes on, or gives back,
+// what the sleepers lend. lk->lk must be held.
+void
+piowner(struct sleeplock *lk, struct proc *owner)
+{
+  acquire(&pilock);
+  if(lk->owner)
+    unlendfrom(lk->owner, lk);
+  lk->owner = owner;
+  if(owner)
+    lendfrom(owner, lk);
+  repri(myproc());
+  release(&pilock);
+}
+
+// Set the priority of the thread or process with the given
+// pid, or of the caller if pid is 0; 0 is the most urgent.
+// Kernel threads keep theirs.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  if(p->kfn){
     release(&p->lock);
+    return -1;
   }
-  return -1;
+  acquire(&pilock);
+  p->baseprio = prio;
+  repri(p);
+  release(&pilock);
+  release(&p->lock);
+  return 0;
+}
+
+// The priority pid runs at, or the caller if pid is 0: the
+// one it was given, or a more urgent one lent by processes
+// waiting for a sleeplock it holds.
+int
+getpriority(int pid)
+{
+  struct proc *p;
+  int prio;
+
+  if(pid == 0)
+    return myproc()->prio;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  prio = p->prio;
+  release(&p->lock);
+  return prio;
 }
 
 // Copy to either a user address, or kernel address,
@@ -626,6 +1578,21 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+int
+schedstats(char *buf, int sz)
+{
+  int n;
+
+  n = snprintf(buf, sz, "sched: %lu affine wakeups, %lu handoffs, %lu stolen\n",
+               sstats.naffine, sstats.nhandoff, sstats.nstolen);
+  n += snprintf(buf+n, sz-n, "sched: runnable to running: %lu us avg, %lu us max\n",
+                sstats.waitsum / (sstats.nrun ? sstats.nrun : 1) / (CLINT_FREQ/1000000),
+                sstats.waitmax / (CLINT_FREQ/1000000));
+  n += snprintf(buf+n, sz-n, "sched: %lu priorities lent to sleeplock holders, %lu along chains\n",
+                pistats.nboost, pistats.nchained);
+  return n;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -641,9 +1608,11 @@ procdump(void)
   };
   struct proc *p;
   char *state;
+  int i, n = tablesize();
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(i = 0; i < n; i++){
+    p = procs[i];
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
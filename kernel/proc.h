@@ -24,9 +24,19 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int nproc;                  // Proc table slots whose kernel stacks it has fenced.
+  struct proc *next;          // Woken by a process running here; run it next.
+  uint64 offstart;            // When noff last left zero with interrupts on,
+  uint64 offpc;               // and the code that did it.
+  uint64 offmax;              // Longest time noff has kept preemption off,
+  uint64 offmaxpc;            // and where that began.
+  struct mcsnode mcs[NMCS];   // For the MCS locks it is holding or waiting for,
+  uint mcsused;               // one bit each.
 };
 
 extern struct cpu cpus[NCPU];
+extern int onlineharts;       // harts that have reached scheduler(), one bit each
+extern int idleharts;         // harts waiting in scheduler() for a process to run
 
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
@@ -82,27 +92,58 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
+// Per-thread state. A process is a thread group: the leader,
+// plus any threads created by clone(), which share the
+// leader's address space, open files and current directory.
+// those are kept only in the leader, and guarded by its glock.
 struct proc {
   struct spinlock lock;
+  struct spinlock glock;       // in the leader: sz, pagetable, ofile, cwd
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
-  int pid;                     // Process ID
+  int pid;                     // Process ID; changes under ptable_lock too
+  int affinity;                // Harts it may run on, one bit each
+  uint64 readyat;              // When it last became RUNNABLE
+  int wakecpu;                 // Hart that woke it and may run it first, or -1
+  uint64 affineuntil;          // When other harts may take it anyway
 
-  // wait_lock must be held when using this:
-  struct proc *parent;         // Parent process
+  // pilock (proc.c) must be held when changing these:
+  int baseprio;                // Its own scheduling priority
+  int prio;                    // and that lent to it by waiters; scheduler() uses it
+  struct sleeplock *blockedon; // Sleeplock it is asleep waiting for
+  struct sleeplock *lent;      // Sleeplocks it holds whose sleepers lend it priority
+
+  // wait_lock must be held when using these:
+  struct proc *parent;         // Parent process; 0 for a non-leader thread
+  struct proc *children;       // in the leader: its child processes
+  struct proc *threads;        // in the leader: its other threads
+  struct proc *sibling;        // next on parent's children or leader's threads
+  struct proc **psibling;      // points at whatever points to us
+  int nthread;                 // in the leader: live threads, including itself
+  int growing;                 // in the leader, under glock: in growproc()
+
+  struct proc *leader;         // Thread group leader; p itself for a process
+
+  // ptable_lock (proc.c) must be held when using these:
+  struct proc *hashnext;       // next in pid hash chain
+  struct proc *nextfree;       // next on the free list, if UNUSED
 
   // these are private to the process, so p->lock need not be held.
+  int slot;                    // index in the proc table; fixed
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  pagetable_t pagetable;       // User page table, shared by the group
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 tfva;                 // where trapframe is mapped in pagetable
+  struct usyscall *usyscall;   // read-only page for ulib (memlayout.h)
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void*);          // If non-zero, a kernel thread running kfn(karg)
+  void *karg;
 };
@@ -0,0 +1,221 @@
+//
+// read-copy-update, for tables that are read much more often
+// than they change. readers take no locks: they bracket their
+// use of the table with rcu_read_lock() and rcu_read_unlock(),
+// and must not sleep in between. a writer, holding whatever
+// lock writers use, unlinks an entry so that new readers can't
+// find it, and reuses it only after a grace period, by when
+// every reader that might have found it has finished: it
+// waits with synchronize_rcu(), or has call_rcu() call it back.
+//
+// a reader keeps interrupts off, so its hart can't switch
+// processes until it is done. so once every hart has been
+// through scheduler() since a grace period began, each has
+// passed a quiescent state, and the readers from before the
+// grace period are all done.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "workqueue.h"
+#include "rcu.h"
+#include "defs.h"
+
+static struct {
+  struct spinlock lock;
+  uint64 gp;                  // grace periods begun
+  int need;                   // harts yet to pass a quiescent state in gp
+  uint64 start;               // when gp began
+
+  // callbacks, oldest first, each list with the address
+  // of its last next pointer.
+  struct rcu_head *next, **nexttail;  // for the next grace period
+  struct rcu_head *cur, **curtail;    // for gp
+  struct rcu_head *done, **donetail;  // to be called
+
+  // calls the done callbacks, always on hart 0's worker,
+  // so that they are called in the order they were queued.
+  struct work work;
+
+  uint64 ncalls;
+  uint64 ngp;                 // grace periods completed
+  uint64 gpsum;               // mtime cycles they took
+  uint64 gpmax;
+} rcu;
+
+// the last grace period each hart passed a quiescent
+// state in. only that hart writes its own.
+static uint64 seen[NCPU];
+
+static void rcudone(void*);
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+  rcu.nexttail = &rcu.next;
+  rcu.curtail = &rcu.cur;
+  rcu.donetail = &rcu.done;
+  init_work(&rcu.work, rcudone, 0);
+}
+
+// readers must not sleep, or be preempted, until
+// rcu_read_unlock(). they may nest.
+void
+rcu_read_lock(void)
+{
+  push_off();
+}
+
+void
+rcu_read_unlock(void)
+{
+  pop_off();
+}
+
+static void startgp(void);
+
+// gp is over: its callbacks can be called, and the
+// next grace period begin. rcu.lock must be held.
+static void
+endgp(void)
+{
+  uint64 t = timer_now() - rcu.start;
+
+  rcu.ngp++;
+  rcu.gpsum += t;
+  if(t > rcu.gpmax)
+    rcu.gpmax = t;
+  if(rcu.cur){
+    *rcu.donetail = rcu.cur;
+    rcu.donetail = rcu.curtail;
+    rcu.cur = 0;
+    rcu.curtail = &rcu.cur;
+    queue_work_on(0, &rcu.work);
+  }
+  if(rcu.next)
+    startgp();
+}
+
+// begin a grace period for the callbacks queued so far.
+// none may be under way. rcu.lock must be held.
+static void
+startgp(void)
+{
+  rcu.cur = rcu.next;
+  rcu.curtail = rcu.nexttail;
+  rcu.next = 0;
+  rcu.nexttail = &rcu.next;
+  rcu.start = timer_now();
+  rcu.need = __atomic_load_n(&onlineharts, __ATOMIC_RELAXED);
+  // publish need before gp, which rcu_qs() reads without rcu.lock.
+  __atomic_store_n(&rcu.gp, rcu.gp + 1, __ATOMIC_RELEASE);
+  // an idle hart has no readers, and may wait in wfi for
+  // long. one that goes idle after this sees the new gp
+  // when it calls rcu_qs() on the way.
+  __sync_synchronize();
+  rcu.need &= ~__atomic_load_n(&idleharts, __ATOMIC_RELAXED);
+  // before the first hart reaches scheduler(),
+  // there are no readers to wait for.
+  if(rcu.need == 0)
+    endgp();
+}
+
+// the calling hart is in scheduler(), between processes, and
+// so in a quiescent state. cheap unless a grace period is
+// waiting for this hart.
+void
+rcu_qs(void)
+{
+  int id = cpuid();
+
+  if(seen[id] == __atomic_load_n(&rcu.gp, __ATOMIC_ACQUIRE))
+    return;
+  acquire(&rcu.lock);
+  seen[id] = rcu.gp;
+  if(rcu.need & (1 << id)){
+    rcu.need &= ~(1 << id);
+    if(rcu.need == 0)
+      endgp();
+  }
+  release(&rcu.lock);
+}
+
+// call fn(h) after a grace period has passed. may be
+// called with spinlocks held, including by a reader.
+void
+call_rcu(struct rcu_head *h, void (*fn)(struct rcu_head*))
+{
+  acquire(&rcu.lock);
+  h->fn = fn;
+  h->next = 0;
+  *rcu.nexttail = h;
+  rcu.nexttail = &h->next;
+  rcu.ncalls++;
+  if(rcu.cur == 0)    // no grace period under way
+    startgp();
+  release(&rcu.lock);
+}
+
+// call the callbacks whose grace periods are over.
+static void
+rcudone(void *arg)
+{
+  struct rcu_head *h, *next;
+
+  acquire(&rcu.lock);
+  h = rcu.done;
+  rcu.done = 0;
+  rcu.donetail = &rcu.done;
+  release(&rcu.lock);
+
+  for(; h; h = next){
+    next = h->next;
+    h->fn(h);
+  }
+}
+
+struct waiter {
+  struct rcu_head h;    // first, for the cast in wake()
+  int done;
+};
+
+static void
+wake(struct rcu_head *h)
+{
+  struct waiter *w = (struct waiter*)h;
+
+  acquire(&rcu.lock);
+  w->done = 1;
+  wakeup(w);
+  release(&rcu.lock);
+}
+
+// wait for a grace period to pass, and for every callback
+// queued before this to have been called.
+void
+synchronize_rcu(void)
+{
+  struct waiter w;
+
+  w.done = 0;
+  call_rcu(&w.h, wake);
+  acquire(&rcu.lock);
+  while(!w.done)
+    sleep(&w, &rcu.lock);
+  release(&rcu.lock);
+}
+
+int
+rcustats(char *buf, int sz)
+{
+  uint64 us = CLINT_FREQ/1000000;
+
+  return snprintf(buf, sz, "rcu: %lu callbacks, %lu grace periods, %lu us avg, %lu us max\n",
+                  rcu.ncalls, rcu.ngp, rcu.gpsum / (rcu.ngp ? rcu.ngp : 1) / us, rcu.gpmax / us);
+}
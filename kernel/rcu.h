@@ -0,0 +1,7 @@
+// Deferred reuse: after a grace period, call_rcu() calls
+// fn(head), in process context with no locks held. Embed
+// the head in whatever fn is to free.
+struct rcu_head {
+  struct rcu_head *next;
+  void (*fn)(struct rcu_head*);
+};
@@ -0,0 +1,133 @@
+//
+// reapers: a kernel thread on each hart that frees the
+// address spaces of exited processes and of images replaced
+// by exec(), so that exit(), wait() and exec() don't take
+// time in proportion to how much memory was in use.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NREAP 32  // address spaces a reaper can have queued
+
+struct reaper {
+  struct spinlock lock;
+  int started;
+  int n;                      // address spaces queued
+  int busy;                   // freeing one
+  struct {
+    pagetable_t pagetable;
+    uint64 sz;
+  } q[NREAP];
+};
+
+static struct reaper reapers[NCPU];
+
+// updated atomically, since each reaper has its own lock.
+static struct {
+  uint64 nreaped;       // address spaces freed by reapers
+  uint64 npages;        // of their user pages
+  uint64 nsync;         // freed at once, for want of queue space
+} rstats;
+
+static void
+reaper(void *arg)
+{
+  struct reaper *r = arg;
+  pagetable_t pagetable;
+  uint64 sz;
+
+  acquire(&r->lock);
+  for(;;){
+    while(r->n == 0)
+      sleep(r, &r->lock);
+    r->n--;
+    pagetable = r->q[r->n].pagetable;
+    sz = r->q[r->n].sz;
+    r->busy = 1;
+    release(&r->lock);
+
+    // holds no locks, so it can be preempted.
+    proc_freepagetable(pagetable, sz);
+    __sync_fetch_and_add(&rstats.nreaped, 1);
+    __sync_fetch_and_add(&rstats.npages, PGROUNDUP(sz) / PGSIZE);
+
+    acquire(&r->lock);
+    r->busy = 0;
+    if(r->n == 0)
+      wakeup(&r->busy);
+  }
+}
+
+// start the calling hart's reaper.
+void
+reaperinit(void)
+{
+  struct reaper *r = &reapers[cpuid()];
+
+  initlock(&r->lock, "reaper");
+  if(kthread("reaper", reaper, r, 1 << cpuid()) == 0)
+    panic("reaperinit");
+  r->started = 1;
+}
+
+// free pagetable, and the sz bytes of user memory it maps,
+// in the background. nothing may use it any more.
+void
+reap(pagetable_t pagetable, uint64 sz)
+{
+  struct reaper *r;
+
+  push_off();
+  r = &reapers[cpuid()];
+  pop_off();
+
+  if(r->started){
+    acquire(&r->lock);
+    if(r->n < NREAP){
+      r->q[r->n].pagetable = pagetable;
+      r->q[r->n].sz = sz;
+      r->n++;
+      wakeup(r);
+      release(&r->lock);
+      return;
+    }
+    release(&r->lock);
+  }
+  __sync_fetch_and_add(&rstats.nsync, 1);
+  proc_freepagetable(pagetable, sz);
+}
+
+// wait for every reaper to finish what it has queued, for a
+// caller short of memory. returns 1 if there was anything to
+// wait for, in which case more memory may now be free.
+int
+reapwait(void)
+{
+  struct reaper *r;
+  int waited = 0;
+
+  for(r = reapers; r < &reapers[NCPU]; r++){
+    if(!r->started)
+      continue;
+    acquire(&r->lock);
+    while(r->n > 0 || r->busy){
+      waited = 1;
+      sleep(&r->busy, &r->lock);
+    }
+    release(&r->lock);
+  }
+  return waited;
+}
+
+int
+reapstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "reap: %lu address spaces, %lu pages, %lu freed synchronously\n",
+                  rstats.nreaped, rstats.npages, rstats.nsync);
+}
@@ -9,6 +9,18 @@
 #include "proc.h"
 #include "sleeplock.h"
 
+// how long acquiresleep() may spin, in mtime cycles, waiting
+// for a holder that is running on another hart.
+#define SPINLIMIT (CLINT_FREQ/100000)
+
+// updated atomically, since many locks update them.
+static struct {
+  uint64 nwait;         // acquires that found the lock held
+  uint64 nspun;         // of those, got it by spinning alone
+  uint64 nslept;        // or slept
+  uint64 nshared;       // acquires in shared mode
+} slstats;
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
@@ -16,17 +28,157 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->readers = 0;
+  lk->xwaiting = 0;
+  lk->nsleeping = 0;
+  memset(lk->sleepers, 0, sizeof(lk->sleepers));
+  lk->nextlent = 0;
+  lk->owner = 0;
+  lk->class = lockclass(name, 1);
+}
+
+// wait without lk->lk while owner keeps lk and runs on another
+// hart, but not past deadline.
+static void
+spin(struct sleeplock *lk, struct proc *owner, uint64 deadline)
+{
+  while(__atomic_load_n(&lk->locked, __ATOMIC_RELAXED) &&
+        __atomic_load_n(&lk->owner, __ATOMIC_RELAXED) == owner &&
+        __atomic_load_n(&owner->state, __ATOMIC_RELAXED) == RUNNING &&
+        timer_now() < deadline)
+    ;
 }
 
+// sleep until lk changes hands, lending the caller's
+// priority to its holder meanwhile. lk->lk must be held.
+static void
+block(struct sleeplock *lk)
+{
+  piblock(lk);
+  sleep(lk, &lk->lk);
+  piunblock(lk);
+}
+
+// buffer and inode locks are mostly held only briefly, so
+// while the holder is running it is cheaper to spin until it
+// releases the lock than to sleep and be woken, which costs
+// two context switches. a holder that is sleeping, or waiting
+// for a hart, may be a while: sleep. shared holders aren't
+// tracked, so waiting for them always sleeps.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  uint64 sleeps = 0, deadline = 0;
+  int waited = 0;
+  struct proc *owner;
+  struct lockclass *lc;
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  while (lk->locked || lk->readers) {
+    if(!waited)
+      lk->xwaiting++;
+    waited = 1;
+    // structs proc are never freed, so owner stays valid.
+    owner = lk->owner;
+    if(lk->locked && owner && owner->state == RUNNING){
+      if(deadline == 0)
+        deadline = timer_now() + SPINLIMIT;
+      if(timer_now() < deadline){
+        release(&lk->lk);
+        spin(lk, owner, deadline);
+        acquire(&lk->lk);
+        continue;
+      }
+    }
+    block(lk);
+    sleeps++;
   }
+  if(waited)
+    lk->xwaiting--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  // waiters still asleep lend their priority to the new holder.
+  if(lk->nsleeping)
+    piowner(lk, myproc());
+  else
+    lk->owner = myproc();
+  if(waited){
+    __sync_fetch_and_add(&slstats.nwait, 1);
+    __sync_fetch_and_add(sleeps ? &slstats.nslept : &slstats.nspun, 1);
+  }
+  // lk->lk keeps interrupts off, so this hart's counters are ours.
+  if((lc = lk->class) != 0){
+    lc->cpu[cpuid()].nacquire++;
+    if(waited){
+      lc->cpu[cpuid()].ncontended++;
+      lc->cpu[cpuid()].nspin += sleeps;
+    }
+    lk->holdstart = r_time();
+  }
+  release(&lk->lk);
+}
+
+// take lk shared, alongside any other shared holders, for
+// code that only reads what lk protects. an exclusive
+// acquirer that is waiting goes first, so that a stream of
+// readers can't starve it; so a process mustn't take a lock
+// shared that it already holds shared.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  uint64 sleeps = 0, deadline = 0;
+  int waited = 0;
+  struct proc *owner;
+  struct lockclass *lc;
+
+  acquire(&lk->lk);
+  while (lk->locked || lk->xwaiting) {
+    waited = 1;
+    owner = lk->owner;
+    if(lk->locked && owner && owner->state == RUNNING){
+      if(deadline == 0)
+        deadline = timer_now() + SPINLIMIT;
+      if(timer_now() < deadline){
+        release(&lk->lk);
+        spin(lk, owner, deadline);
+        acquire(&lk->lk);
+        continue;
+      }
+    }
+    block(lk);
+    sleeps++;
+  }
+  if(waited){
+    __sync_fetch_and_add(&slstats.nwait, 1);
+    __sync_fetch_and_add(sleeps ? &slstats.nslept : &slstats.nspun, 1);
+  }
+  if((lc = lk->class) != 0){
+    lc->cpu[cpuid()].nacquire++;
+    if(waited){
+      lc->cpu[cpuid()].ncontended++;
+      lc->cpu[cpuid()].nspin += sleeps;
+    }
+    // hold time counts from the first shared holder
+    // to the last.
+    if(lk->readers == 0)
+      lk->holdstart = r_time();
+  }
+  lk->readers++;
+  __sync_fetch_and_add(&slstats.nshared, 1);
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers < 1)
+    panic("releasesleepshared");
+  if(--lk->readers == 0){
+    if(lk->class)
+      lk->class->cpu[cpuid()].hold += r_time() - lk->holdstart;
+    wakeup(lk);
+  }
   release(&lk->lk);
 }
 
@@ -34,8 +186,17 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  // r_time(), not r_cycle(), since the holder may have
+  // moved to another hart.
+  if(lk->class)
+    lk->class->cpu[cpuid()].hold += r_time() - lk->holdstart;
   lk->locked = 0;
   lk->pid = 0;
+  // give back the priority the waiters lent.
+  if(lk->nsleeping)
+    piowner(lk, 0);
+  else
+    lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
@@ -51,5 +212,22 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// is lk held shared by someone? holders aren't tracked,
+// so it can't say whether the caller is one of them.
+int
+heldshared(struct sleeplock *lk)
+{
+  int r;
 
+  acquire(&lk->lk);
+  r = lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
 
+int
+sleeplockstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "sleeplock: %lu waits, %lu by spinning, %lu by sleeping; %lu shared\n",
+                  slstats.nwait, slstats.nspun, slstats.nslept, slstats.nshared);
+}
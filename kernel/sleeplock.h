@@ -1,10 +1,21 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Number of shared holders
+  int xwaiting;      // Exclusive acquirers waiting
+  int nsleeping;     // Waiters asleep, lending their priority to owner,
+  int sleepers[NPRIO]; // how many at each priority (pilock in proc.c)
+  struct sleeplock *nextlent; // on owner->lent, while nsleeping > 0
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  struct proc *owner; // and its struct proc, for acquiresleep() and
+                      // priority inheritance
+
+  // For lockstat:
+  struct lockclass *class;
+  uint64 holdstart;  // mtime when acquired, or first shared
 };
 
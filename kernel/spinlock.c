@@ -8,12 +8,91 @@
 #include "proc.h"
 #include "defs.h"
 
+// initialize lk as a lock of the given kind (spinlock.h).
+// a lock that many harts fight over should be LOCK_TICKET,
+// so they get it in turn, or LOCK_MCS, so that they also
+// don't all spin on the same cache line.
 void
-initlock(struct spinlock *lk, char *name)
+initlockkind(struct spinlock *lk, char *name, int kind)
 {
   lk->name = name;
+  lk->kind = kind;
   lk->locked = 0;
+  lk->ticket = 0;
+  lk->serving = 0;
+  lk->tail = 0;
+  lk->node = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name, 0);
+}
+
+void
+initlock(struct spinlock *lk, char *name)
+{
+  initlockkind(lk, name, LOCK_TAS);
+}
+
+// take a free MCS node from this cpu's. interrupts are off.
+static struct mcsnode*
+mcsalloc(struct cpu *c)
+{
+  for(int i = 0; i < NMCS; i++){
+    if((c->mcsused & (1 << i)) == 0){
+      c->mcsused |= 1 << i;
+      return &c->mcs[i];
+    }
+  }
+  panic("mcsalloc");
+}
+
+static void
+mcsfree(struct cpu *c, struct mcsnode *n)
+{
+  c->mcsused &= ~(1 << (n - c->mcs));
+}
+
+// join lk's queue, and spin on our own node until the
+// holder ahead of us passes the lock on.
+// returns the number of times it spun.
+static uint64
+mcsacquire(struct spinlock *lk)
+{
+  struct mcsnode *n, *prev;
+  uint64 spins = 0;
+
+  n = mcsalloc(mycpu());
+  n->next = 0;
+  n->waiting = 1;
+  prev = __atomic_exchange_n(&lk->tail, n, __ATOMIC_ACQ_REL);
+  if(prev){
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+    while(__atomic_load_n(&n->waiting, __ATOMIC_ACQUIRE))
+      spins++;
+  }
+  lk->node = n;
+  return spins;
+}
+
+// pass lk to the next waiter, if there is one.
+static void
+mcsrelease(struct spinlock *lk)
+{
+  struct mcsnode *n = lk->node, *next, *expect = n;
+
+  lk->node = 0;
+  if((next = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE)) == 0){
+    if(__atomic_compare_exchange_n(&lk->tail, &expect, 0, 0,
+                                   __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+      mcsfree(mycpu(), n);
+      return;
+    }
+    // a waiter has swapped itself in as the tail, but
+    // hasn't linked itself to us yet.
+    while((next = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE)) == 0)
+      ;
+  }
+  __atomic_store_n(&next->waiting, 0, __ATOMIC_RELEASE);
+  mcsfree(mycpu(), n);
 }
 
 // Acquire the lock.
@@ -21,16 +100,37 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint t;
+  uint64 spins = 0;
+  struct lockclass *lc;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
+  // name the caller, not push_off(), as where preemption
+  // went off, if it was this acquire that turned it off.
+  if(mycpu()->noff == 1 && mycpu()->intena)
+    mycpu()->offpc = (uint64)__builtin_return_address(0);
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  switch(lk->kind){
+  case LOCK_TICKET:
+    t = __sync_fetch_and_add(&lk->ticket, 1);
+    while(__atomic_load_n(&lk->serving, __ATOMIC_ACQUIRE) != t)
+      spins++;
+    lk->locked = 1;
+    break;
+  case LOCK_MCS:
+    spins = mcsacquire(lk);
+    lk->locked = 1;
+    break;
+  default:
+    // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
+    //   a5 = 1
+    //   s1 = &lk->locked
+    //   amoswap.w.aq a5, a5, (s1)
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+      spins++;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +140,16 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  if((lc = lk->class) != 0){
+    t = cpuid();
+    lc->cpu[t].nacquire++;
+    if(spins){
+      lc->cpu[t].ncontended++;
+      lc->cpu[t].nspin += spins;
+    }
+    lk->holdstart = r_cycle();
+  }
 }
 
 // Release the lock.
@@ -49,6 +159,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  if(lk->class)
+    lk->class->cpu[cpuid()].hold += r_cycle() - lk->holdstart;
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,14 +172,26 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  switch(lk->kind){
+  case LOCK_TICKET:
+    // only the holder writes serving.
+    lk->locked = 0;
+    __atomic_store_n(&lk->serving, lk->serving + 1, __ATOMIC_RELEASE);
+    break;
+  case LOCK_MCS:
+    lk->locked = 0;
+    mcsrelease(lk);
+    break;
+  default:
+    // Release the lock, equivalent to lk->locked = 0.
+    // This code doesn't use a C assignment, since the C standard
+    // implies that an assignment might be implemented with
+    // multiple store instructions.
+    // On RISC-V, sync_lock_release turns into an atomic swap:
+    //   s1 = &lk->locked
+    //   amoswap.w zero, zero, (s1)
+    __sync_lock_release(&lk->locked);
+  }
 
   pop_off();
 }
@@ -84,6 +209,11 @@ holding(struct spinlock *lk)
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
+//
+// noff is thus the kernel's preemption count: a timer interrupt
+// can preempt kernel code only when it is zero and interrupts
+// are on. each hart records the longest stretch for which a
+// push_off() kept it from being preempted, and where it began.
 
 void
 push_off(void)
@@ -91,8 +221,13 @@ push_off(void)
   int old = intr_get();
 
   intr_off();
-  if(mycpu()->noff == 0)
+  if(mycpu()->noff == 0){
     mycpu()->intena = old;
+    if(old){
+      mycpu()->offstart = timer_now();
+      mycpu()->offpc = (uint64)__builtin_return_address(0);
+    }
+  }
   mycpu()->noff += 1;
 }
 
@@ -100,11 +235,61 @@ void
 pop_off(void)
 {
   struct cpu *c = mycpu();
+  uint64 off;
+
   if(intr_get())
     panic("pop_off - interruptible");
   if(c->noff < 1)
     panic("pop_off");
   c->noff -= 1;
-  if(c->noff == 0 && c->intena)
+  if(c->noff == 0 && c->intena){
+    off = timer_now() - c->offstart;
+    if(off > c->offmax){
+      c->offmax = off;
+      c->offmaxpc = c->offpc;
+    }
     intr_on();
+  }
+}
+
+// locks for lockbench(), one of each kind.
+static struct spinlock benchlocks[] = {
+  [LOCK_TAS]    { .kind = LOCK_TAS, .name = "bench tas" },
+  [LOCK_TICKET] { .kind = LOCK_TICKET, .name = "bench ticket" },
+  [LOCK_MCS]    { .kind = LOCK_MCS, .name = "bench mcs" },
+};
+static uint64 benchcount;
+
+// for user/lockbench.c: acquire and release the lock of the
+// given kind n times. returns the microseconds taken.
+int
+lockbench(int kind, int n)
+{
+  struct spinlock *lk;
+  uint64 t0;
+
+  if(kind < 0 || kind >= NELEM(benchlocks) || n < 0)
+    return -1;
+  lk = &benchlocks[kind];
+  t0 = timer_now();
+  for(int i = 0; i < n; i++){
+    acquire(lk);
+    benchcount++;
+    release(lk);
+  }
+  return (timer_now() - t0) / (CLINT_FREQ/1000000);
+}
+
+int
+preemptstats(char *buf, int sz)
+{
+  int n = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].offmax == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "preempt: hart %d: longest off %lu us, from %lx\n",
+                  i, cpus[i].offmax / (CLINT_FREQ/1000000), cpus[i].offmaxpc);
+  }
+  return n;
 }
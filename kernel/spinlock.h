@@ -1,9 +1,45 @@
 // Mutual exclusion lock.
+// Waiters take turns in one of three ways, chosen when the
+// lock is initialized (initlockkind() in spinlock.c):
+#define LOCK_TAS    0  // all spin on locked; no order
+#define LOCK_TICKET 1  // FIFO, but all spin on serving
+#define LOCK_MCS    2  // FIFO, each spins on its own mcsnode
+
+// a hart waiting for or holding an MCS lock (cpu.mcs[]).
+struct mcsnode {
+  struct mcsnode *next;  // the waiter after us
+  int waiting;           // cleared when the lock passes to us
+};
+
+// the profile of every lock with one name, so that e.g.
+// all the procs' locks are counted together (lockstat.c).
+// each hart has its own counters, and adds to them only
+// while it holds the lock, so none are lost.
+#define NLOCKCLASS 64
+struct lockclass {
+  char *name;
+  int sleep;             // of sleeplocks, rather than spinlocks?
+  struct {
+    uint64 nacquire;
+    uint64 ncontended;   // acquires that had to wait
+    uint64 nspin;        // spin loops while waiting; sleeps, for a sleeplock
+    uint64 hold;         // cycles held; mtime cycles, for a sleeplock
+  } cpu[NCPU];
+};
+
 struct spinlock {
   uint locked;       // Is the lock held?
+  int kind;          // LOCK_TAS, LOCK_TICKET or LOCK_MCS
+  uint ticket;       // LOCK_TICKET: next ticket to hand out,
+  uint serving;      // and the one whose holder may go in.
+  struct mcsnode *tail; // LOCK_MCS: the last waiter, or the holder
+  struct mcsnode *node; // and the holder's node.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
+  // For lockstat:
+  struct lockclass *class; // or 0, to not profile it
+  uint64 holdstart;  // cycle counter when acquired
+};
@@ -0,0 +1,116 @@
+//
+// formatted output into a buffer -- snprintf.
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+static char digits[] = "0123456789abcdef";
+
+static int
+sputc(char *s, int sz, int off, char c)
+{
+  if(off < sz)
+    s[off] = c;
+  return 1;
+}
+
+static int
+sprintint(char *s, int sz, int off, uint64 x, int base, int sign)
+{
+  char buf[24];
+  int i, n;
+
+  if(sign && (sign = (long)x < 0))
+    x = -(long)x;
+
+  i = 0;
+  do {
+    buf[i++] = digits[x % base];
+  } while((x /= base) != 0);
+
+  if(sign)
+    buf[i++] = '-';
+
+  n = 0;
+  while(--i >= 0)
+    n += sputc(s, sz, off+n, buf[i]);
+  return n;
+}
+
+// Format into buf, writing at most sz bytes and no
+// terminating nul. Returns the number of bytes written.
+// Understands %d, %x, %s, and %ld/%lu/%lx for 64-bit values.
+int
+snprintf(char *buf, int sz, char *fmt, ...)
+{
+  va_list ap;
+  int i, c, l;
+  int off = 0;
+  char *s;
+
+  if(fmt == 0)
+    panic("null fmt");
+
+  va_start(ap, fmt);
+  for(i = 0; off < sz && (c = fmt[i] & 0xff) != 0; i++){
+    if(c != '%'){
+      off += sputc(buf, sz, off, c);
+      continue;
+    }
+    c = fmt[++i] & 0xff;
+    l = 0;
+    if(c == 'l'){
+      l = 1;
+      c = fmt[++i] & 0xff;
+    }
+    if(c == 0)
+      break;
+    switch(c){
+    case 'd':
+      if(l)
+        off += sprintint(buf, sz, off, va_arg(ap, uint64), 10, 1);
+      else
+        off += sprintint(buf, sz, off, va_arg(ap, int), 10, 1);
+      break;
+    case 'u':
+      if(l)
+        off += sprintint(buf, sz, off, va_arg(ap, uint64), 10, 0);
+      else
+        off += sprintint(buf, sz, off, va_arg(ap, uint), 10, 0);
+      break;
+    case 'x':
+      if(l)
+        off += sprintint(buf, sz, off, va_arg(ap, uint64), 16, 0);
+      else
+        off += sprintint(buf, sz, off, va_arg(ap, uint), 16, 0);
+      break;
+    case 's':
+      if((s = va_arg(ap, char*)) == 0)
+        s = "(null)";
+      for(; *s && off < sz; s++)
+        off += sputc(buf, sz, off, *s);
+      break;
+    case '%':
+      off += sputc(buf, sz, off, '%');
+      break;
+    default:
+      // Print unknown % sequence to draw attention.
+      off += sputc(buf, sz, off, '%');
+      off += sputc(buf, sz, off, c);
+      break;
+    }
+  }
+  va_end(ap);
+  if(off > sz)
+    off = sz;
+  return off;
+}
@@ -5,21 +5,32 @@
 #include "defs.h"
 
 void main();
+void mtrapinit();
 void timerinit();
+void sstcinit();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][6];
+
+// does the hart have the Sstc extension? if so, the kernel
+// programs stimecmp directly and timervec is never used.
+int timer_sstc;
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
+extern int sstcprobe();
 
 // entry.S jumps here in machine mode on stack0.
 void
 start()
 {
+  // look for Sstc first: the probe may take a machine-mode
+  // trap, and the mret from that would overwrite MPP below.
+  int sstc = sstcprobe();
+
   // set M Previous Privilege mode to Supervisor, for mret.
   unsigned long x = r_mstatus();
   x &= ~MSTATUS_MPP_MASK;
@@ -43,8 +54,17 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
-  // ask for clock interrupts.
-  timerinit();
+  // let supervisor mode, and user mode if the kernel
+  // allows it, read the time CSR, and the cycle CSR
+  // for lockstat.
+  w_mcounteren(r_mcounteren() | MCOUNTEREN_TM | MCOUNTEREN_CY);
+
+  // ask for clock interrupts, and for other harts' kicks.
+  mtrapinit();
+  if(sstc)
+    sstcinit();
+  else
+    timerinit();
 
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
@@ -54,27 +74,39 @@ start()
   asm volatile("mret");
 }
 
-// set up to receive timer interrupts in machine mode,
-// which arrive at timervec in kernelvec.S,
-// which turns them into software interrupts for
-// devintr() in trap.c.
+// with Sstc, supervisor-mode timer interrupts are delegated
+// like any other, and the kernel arms them by writing stimecmp.
+// no machine-mode trap is involved.
 void
-timerinit()
+sstcinit()
+{
+  timer_sstc = 1;
+
+  // leave the timer disarmed until the kernel sets it.
+  w_stimecmp(-1);
+}
+
+// set up to receive machine-mode interrupts, the CLINT's
+// timer and software interrupts, which arrive at timervec
+// in kernelvec.S, which turns them into supervisor software
+// interrupts for devintr() in trap.c. the software interrupt
+// is how timer_kick() wakes an idle hart, with or without Sstc.
+void
+mtrapinit()
 {
-  // each CPU has a separate source of timer interrupts.
   int id = r_mhartid();
 
-  // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  *(uint32*)CLINT_MSIP(id) = 0;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
-  // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[4] : count of timer interrupts taken, for statistics.
+  // scratch[5] : address of CLINT MSIP register.
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
-  scratch[4] = interval;
+  scratch[4] = 0;
+  scratch[5] = CLINT_MSIP(id);
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -83,6 +115,23 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
+  // enable machine-mode software interrupts.
+  w_mie(r_mie() | MIE_MSIE);
+}
+
+// set up to receive timer interrupts in machine mode,
+// at timervec.
+void
+timerinit()
+{
+  // each CPU has a separate source of timer interrupts.
+  int id = r_mhartid();
+
+  // leave the CLINT's timer disarmed. the kernel programs
+  // mtimecmp itself, one interrupt at a time, for whatever
+  // is due next (see timer.c).
+  *(uint64*)CLINT_MTIMECMP(id) = -1;
+
   // enable machine-mode timer interrupts.
   w_mie(r_mie() | MIE_MTIE);
 }
@@ -0,0 +1,84 @@
+//
+// the statistics device: read it to get a text dump of
+// the kernel's performance counters.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ 4096
+
+static struct {
+  struct spinlock lock;
+  char buf[BUFSZ];
+  int sz;
+  int off;
+} stats;
+
+// each subsystem's counters, formatted into a buffer.
+static int (*statsfns[])(char*, int) = {
+  timerstats,
+  schedstats,
+  preemptstats,
+  futexstats,
+  reapstats,
+  workstats,
+  irqstats,
+  sleeplockstats,
+  rcustats,
+  inodestats,
+  waitqueuestats,
+  bcachestats,
+};
+
+int
+statswrite(int user_src, uint64 src, int n)
+{
+  return -1;
+}
+
+// the first read of a dump formats all the counters;
+// subsequent reads return the rest of it, and then
+// end-of-file, after which the next read starts over.
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int i, m;
+
+  acquire(&stats.lock);
+
+  if(stats.sz == 0) {
+    for(i = 0; i < NELEM(statsfns); i++)
+      stats.sz += statsfns[i](stats.buf+stats.sz, BUFSZ-stats.sz);
+  }
+  m = stats.sz - stats.off;
+
+  if (m > 0) {
+    if(m > n)
+      m  = n;
+    if(either_copyout(user_dst, dst, stats.buf+stats.off, m) != -1) {
+      stats.off += m;
+    }
+  } else {
+    m = 0;
+    stats.sz = 0;
+    stats.off = 0;
+  }
+  release(&stats.lock);
+  return m;
+}
+
+void
+statsinit(void)
+{
+  initlock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
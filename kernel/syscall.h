@@ -20,3 +20,16 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_clock_gettime 22
+#define SYS_nanosleep 23
+#define SYS_clone 24
+#define SYS_join 25
+#define SYS_futex_wait 26
+#define SYS_futex_wake 27
+#define SYS_sched_setaffinity 28
+#define SYS_sched_getaffinity 29
+#define SYS_irq_setaffinity 30
+#define SYS_irq_getaffinity 31
+#define SYS_lockbench 32
+#define SYS_setpriority 33
+#define SYS_getpriority 34
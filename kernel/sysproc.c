@@ -20,7 +20,7 @@ sys_exit(void)
 uint64
 sys_getpid(void)
 {
-  return myproc()->pid;
+  return myproc()->leader->pid;
 }
 
 uint64
@@ -41,36 +41,23 @@ sys_wait(void)
 uint64
 sys_sbrk(void)
 {
-  int addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
-    return -1;
-  return addr;
+  return growproc(n);
 }
 
 uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return timer_sleep(n);
 }
 
 uint64
@@ -91,7 +78,179 @@ sys_uptime(void)
   uint xticks;
 
   acquire(&tickslock);
+  tickupdate();
   xticks = ticks;
   release(&tickslock);
   return xticks;
 }
+
+// return the time since boot, to the resolution of the
+// CLINT's mtime counter.
+uint64
+sys_clock_gettime(void)
+{
+  uint64 addr, now;
+  struct timespec ts;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  now = timer_now();
+  ts.sec = now / CLINT_FREQ;
+  ts.nsec = (now % CLINT_FREQ) * 1000000000 / CLINT_FREQ;
+  if(copyout(myproc()->pagetable, addr, (char *)&ts, sizeof(ts)) < 0)
+    return -1;
+  return 0;
+}
+
+// Fetch the nth system call argument as a pointer to a
+// struct timespec interval, and return it in mtime cycles,
+// rounded up.
+static int
+arginterval(int n, uint64 *cycles)
+{
+  uint64 addr;
+  struct timespec ts;
+
+  if(argaddr(n, &addr) < 0)
+    return -1;
+  if(copyin(myproc()->pagetable, (char *)&ts, addr, sizeof(ts)) < 0)
+    return -1;
+  if(ts.nsec >= 1000000000)
+    return -1;
+  *cycles = ts.sec * CLINT_FREQ + (ts.nsec * CLINT_FREQ + 999999999) / 1000000000;
+  return 0;
+}
+
+// sleep for the given interval, on a one-shot timer
+// rather than to the next clock tick.
+uint64
+sys_nanosleep(void)
+{
+  uint64 cycles;
+
+  if(arginterval(0, &cycles) < 0)
+    return -1;
+  if(cycles == 0)
+    return 0;
+  return timer_nanosleep(timer_now() + cycles);
+}
+
+// sleep while the int at addr holds val, for at most
+// the interval timeout points to, if it isn't null.
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr, timeout, deadline = 0, cycles;
+  int val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0 || argaddr(2, &timeout) < 0)
+    return -1;
+  if(timeout){
+    if(arginterval(2, &cycles) < 0)
+      return -1;
+    deadline = timer_now() + (cycles ? cycles : 1);
+  }
+  return futex_wait(addr, val, deadline);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futex_wake(addr, n);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, sp;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &sp) < 0)
+    return -1;
+  return clone(fn, arg, sp);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  if(argint(0, &tid) < 0 || argaddr(1, &p) < 0)
+    return -1;
+  return join(tid, p);
+}
+
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  if(argint(0, &pid) < 0 || argint(1, &prio) < 0)
+    return -1;
+  return setpriority(pid, prio);
+}
+
+uint64
+sys_getpriority(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getpriority(pid);
+}
+
+uint64
+sys_lockbench(void)
+{
+  int kind, n;
+
+  if(argint(0, &kind) < 0 || argint(1, &n) < 0)
+    return -1;
+  return lockbench(kind, n);
+}
+
+uint64
+sys_irq_setaffinity(void)
+{
+  int irq, mask;
+
+  if(argint(0, &irq) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return irqsetaffinity(irq, mask);
+}
+
+uint64
+sys_irq_getaffinity(void)
+{
+  int irq;
+
+  if(argint(0, &irq) < 0)
+    return -1;
+  return irqgetaffinity(irq);
+}
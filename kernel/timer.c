@@ -0,0 +1,609 @@
+//
+// one-shot timer programming.
+//
+// rather than taking a periodic interrupt every TICKINTERVAL
+// cycles, each hart arms its CLINT mtimecmp for the nearest
+// pending event: the end of the running process's time slice,
+// or the earliest sys_sleep() deadline. a hart with nothing
+// to run and no sleeper to wake leaves its timer disarmed.
+//
+// timervec in kernelvec.S disarms mtimecmp when it fires and
+// forwards the interrupt to devintr() as a software interrupt;
+// timerintr() then decides what is due and re-arms.
+//
+// a hart with nothing to run waits in wfi. a hart that makes
+// a process RUNNABLE wakes it with timer_kick(), a CLINT
+// software interrupt that timervec forwards the same way.
+//
+// on harts with the Sstc extension the kernel instead writes
+// stimecmp, and the timer interrupt arrives in supervisor mode
+// directly: one trap per event rather than two.
+//
+// kernel timers (struct timer, for sleep() and timeouts) live
+// on a hierarchical timer wheel: NLEVEL levels of WHEELSIZE
+// slots, level L holding timers due within WHEELSIZE^(L+1)
+// ticks. a slot of level L is cascaded down into level L-1
+// when the clock reaches it, and a level-0 slot fires.
+// adding and removing a timer is O(1).
+//
+// timers that need better than tick resolution, for
+// nanosleep(), go on a separate list sorted by deadline in
+// cycles; the one-shot timer is armed for the nearest of them.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define NEVER ((uint64)-1)
+
+#define WHEELBITS 6
+#define WHEELSIZE (1 << WHEELBITS)
+#define WHEELMASK (WHEELSIZE - 1)
+#define NLEVEL    4
+#define WHEELSPAN (1U << (WHEELBITS * NLEVEL)) // ticks the wheel covers
+
+// struct timer pending states.
+#define ONWHEEL 1
+#define EXPIRED 2
+#define ONHR    3
+
+// in start.c; timer_scratch[hart][4] counts machine-mode timer traps.
+extern uint64 timer_scratch[NCPU][6];
+extern int timer_sstc;
+
+// per-hart timer state. only touched by the owning hart,
+// with interrupts off.
+struct hart {
+  uint64 armed;       // deadline the timer is armed for.
+  uint64 slice;       // end of the running process's time slice.
+  uint64 nintr;       // timer interrupts taken.
+  uint64 nidle;       // of those, how many found nothing running.
+  uint64 idlecycles;  // cycles spent handling the idle ones.
+  uint64 latency;     // total cycles from deadline to timerintr().
+  uint64 maxlatency;  // worst of those.
+  struct timer *running; // whose fn runtimers() is calling.
+};
+static struct hart harts[NCPU];
+
+struct {
+  struct spinlock lock;
+  uint clk;             // next tick to process.
+  int count;            // timers on the wheel.
+  struct timer *slot[NLEVEL][WHEELSIZE];
+  struct timer *hr;     // high-resolution timers, soonest first.
+  struct timer *expired; // due, fn not yet called.
+  uint64 nextdue;       // no timer fires before this, in cycles.
+  uint64 nfired;
+} wheel;
+
+// the time CSR mirrors the CLINT's mtime (start() lets
+// supervisor mode read it on every hart), and reading it
+// costs no uncached load, which matters in push_off() and
+// pop_off().
+uint64
+timer_now(void)
+{
+  return r_time();
+}
+
+static void
+timer_set(uint64 when)
+{
+  if(timer_sstc)
+    w_stimecmp(when);
+  else
+    *(uint64*)CLINT_MTIMECMP(cpuid()) = when;
+}
+
+uint
+timer_ticks(void)
+{
+  return timer_now() / TICKINTERVAL;
+}
+
+// arm the timer for the nearer of this hart's slice end
+// and the next kernel timer. interrupts must be off.
+// wheel.nextdue is read without the wheel's lock; a hart
+// that lowers it always passes through here before it
+// next sleeps.
+static void
+rearm(struct hart *h)
+{
+  uint64 when = h->slice;
+
+  if(wheel.nextdue < when)
+    when = wheel.nextdue;
+  if(when != h->armed){
+    h->armed = when;
+    timer_set(when);
+  }
+}
+
+void
+timerinithart(void)
+{
+  struct hart *h = &harts[cpuid()];
+
+  h->slice = NEVER;
+  h->armed = NEVER;
+  timer_set(NEVER);
+
+  // let user mode read the time CSR, for uptime()
+  // from the USYSCALL page.
+  w_scounteren(r_scounteren() | SCOUNTEREN_TM);
+}
+
+// bring the clock in p's USYSCALL page up to date,
+// on the way back to user space.
+void
+timer_publish(struct usyscall *u)
+{
+  uint t = timer_ticks();
+
+  if(u->ticks == t && u->interval != 0)
+    return;
+  u->seq++;
+  __sync_synchronize();
+  u->ticks = t;
+  u->base = (uint64)t * TICKINTERVAL;
+  u->interval = TICKINTERVAL;
+  __sync_synchronize();
+  u->seq++;
+}
+
+// the scheduler is about to run a process on this hart:
+// give it a fresh time slice. interrupts must be off.
+void
+timer_slice(void)
+{
+  struct hart *h = &harts[cpuid()];
+
+  h->slice = timer_now() + TICKINTERVAL;
+  rearm(h);
+}
+
+// wake hart id from wfi, as if its timer had fired.
+void
+timer_kick(int id)
+{
+  *(uint32*)CLINT_MSIP(id) = 1;
+}
+
+// the scheduler found nothing to run on this hart:
+// stop the tick until a sleeper is due.
+void
+timer_idle(void)
+{
+  struct hart *h;
+
+  push_off();
+  h = &harts[cpuid()];
+  h->slice = NEVER;
+  rearm(h);
+  pop_off();
+}
+
+static void
+link(struct timer **head, struct timer *t)
+{
+  t->next = *head;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+}
+
+static void
+unlink(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// put t in the slot for its expiry, relative to wheel.clk.
+// timers already due go in the slot processed next.
+static void
+place(struct timer *t)
+{
+  uint delta = t->expires - wheel.clk;
+  uint expires = t->expires;
+  int lvl;
+
+  if((int)delta < 0){
+    delta = 0;
+    expires = wheel.clk;
+  } else if(delta >= WHEELSPAN){
+    // beyond the wheel: park it in the last slot of the
+    // top level, and place it again when that cascades.
+    delta = WHEELSPAN - 1;
+    expires = wheel.clk + delta;
+  }
+  for(lvl = 0; lvl < NLEVEL-1; lvl++)
+    if(delta < (1U << (WHEELBITS * (lvl+1))))
+      break;
+  link(&wheel.slot[lvl][(expires >> (WHEELBITS*lvl)) & WHEELMASK], t);
+}
+
+// re-place the timers in the level lvl slot that tick t starts.
+static void
+cascade(int lvl, uint t)
+{
+  struct timer **slot = &wheel.slot[lvl][(t >> (WHEELBITS*lvl)) & WHEELMASK];
+  struct timer *list, *next;
+
+  list = *slot;
+  *slot = 0;
+  for(; list; list = next){
+    next = list->next;
+    place(list);
+  }
+}
+
+// a lower bound on the next tick a timer fires (or needs
+// cascading), so that an idle hart needn't tick until then.
+static uint64
+due(void)
+{
+  uint b, best;
+  int lvl, j;
+
+  if(wheel.count == 0)
+    return NEVER;
+
+  best = wheel.clk + WHEELSPAN;
+  for(j = 0; j < WHEELSIZE; j++){
+    if(wheel.slot[0][(wheel.clk + j) & WHEELMASK]){
+      best = wheel.clk + j;
+      break;
+    }
+  }
+
+  // a higher-level slot may cascade a timer down
+  // before the earliest level-0 one is due.
+  for(lvl = 1; lvl < NLEVEL; lvl++){
+    b = wheel.clk >> (WHEELBITS*lvl);
+    j = (wheel.clk & ((1U << (WHEELBITS*lvl)) - 1)) == 0 ? 0 : 1;
+    for(; j <= WHEELSIZE; j++){
+      if(wheel.slot[lvl][(b + j) & WHEELMASK]){
+        if(((b + j) << (WHEELBITS*lvl)) - wheel.clk < best - wheel.clk)
+          best = (b + j) << (WHEELBITS*lvl);
+        break;
+      }
+    }
+  }
+  return (uint64)best * TICKINTERVAL;
+}
+
+// process every tick up to and including now,
+// moving timers that are due to the expired list.
+static void
+advance(uint now)
+{
+  struct timer **slot;
+  uint t;
+  int lvl;
+
+  while((int)(now - wheel.clk) >= 0){
+    if(wheel.count == 0){
+      // nothing to fire or cascade; skip ahead.
+      wheel.clk = now + 1;
+      break;
+    }
+    t = wheel.clk;
+
+    // cascade each level whose lower levels have wrapped,
+    // highest first.
+    for(lvl = 1; lvl < NLEVEL; lvl++)
+      if(((t >> (WHEELBITS*(lvl-1))) & WHEELMASK) != 0)
+        break;
+    while(--lvl >= 1)
+      cascade(lvl, t);
+
+    slot = &wheel.slot[0][t & WHEELMASK];
+    while(*slot){
+      struct timer *x = *slot;
+      unlink(x);
+      wheel.count--;
+      x->pending = EXPIRED;
+      link(&wheel.expired, x);
+    }
+    wheel.clk++;
+  }
+}
+
+// when the next timer of either kind is due, in cycles.
+static uint64
+soonest(void)
+{
+  uint64 when = due();
+
+  if(wheel.hr && wheel.hr->deadline < when)
+    when = wheel.hr->deadline;
+  return when;
+}
+
+void
+wheelinit(void)
+{
+  initlockkind(&wheel.lock, "timers", LOCK_TICKET);
+  wheel.clk = timer_ticks();
+  wheel.nextdue = NEVER;
+}
+
+static void
+add(struct timer *t)
+{
+  t->pending = ONWHEEL;
+  place(t);
+  wheel.count++;
+  if((uint64)t->expires * TICKINTERVAL < wheel.nextdue)
+    wheel.nextdue = (uint64)t->expires * TICKINTERVAL;
+}
+
+// insert t into the high-resolution list, sorted by deadline.
+static void
+addhr(struct timer *t)
+{
+  struct timer **pp;
+
+  t->pending = ONHR;
+  for(pp = &wheel.hr; *pp && (*pp)->deadline <= t->deadline; pp = &(*pp)->next)
+    ;
+  link(pp, t);
+  if(t->deadline < wheel.nextdue)
+    wheel.nextdue = t->deadline;
+}
+
+// arrange for fn(arg) to be called at tick expires.
+// t must not already be pending.
+void
+timer_add(struct timer *t, uint expires, void (*fn)(void*), void *arg)
+{
+  acquire(&wheel.lock);
+  t->expires = expires;
+  t->fn = fn;
+  t->arg = arg;
+  add(t);
+  release(&wheel.lock);
+
+  // this hart may be running a process; make sure it
+  // takes an interrupt by the new deadline.
+  push_off();
+  rearm(&harts[cpuid()]);
+  pop_off();
+}
+
+static int
+del(struct timer *t)
+{
+  if(!t->pending)
+    return 0;
+  if(t->pending == ONWHEEL)
+    wheel.count--;
+  t->pending = 0;
+  unlink(t);
+  return 1;
+}
+
+// like timer_add(), but deadline is in cycles, for
+// better than tick resolution.
+void
+hrtimer_add(struct timer *t, uint64 deadline, void (*fn)(void*), void *arg)
+{
+  acquire(&wheel.lock);
+  t->deadline = deadline;
+  t->fn = fn;
+  t->arg = arg;
+  addhr(t);
+  release(&wheel.lock);
+
+  push_off();
+  rearm(&harts[cpuid()]);
+  pop_off();
+}
+
+// cancel t. returns 1 if it was pending, 0 if it had already
+// fired; in that case fn may still be running on another hart.
+int
+timer_del(struct timer *t)
+{
+  int r;
+
+  acquire(&wheel.lock);
+  r = del(t);
+  release(&wheel.lock);
+  return r;
+}
+
+// like timer_del(), but if t's fn is running on another
+// hart, wait for it to return, so the caller may free t.
+// must not be called while holding a lock fn takes.
+int
+timer_del_sync(struct timer *t)
+{
+  int r, i;
+
+  acquire(&wheel.lock);
+  r = del(t);
+  for(i = 0; i < NCPU; i++){
+    while(harts[i].running == t){
+      release(&wheel.lock);
+      acquire(&wheel.lock);
+    }
+  }
+  release(&wheel.lock);
+  return r;
+}
+
+// call the functions of timers that are due. each is taken
+// off the expired list under the lock, but called without it,
+// so fn may itself add timers or take other locks.
+// interrupts must be off.
+static void
+runtimers(void)
+{
+  struct timer *t;
+  void (*fn)(void*);
+  void *arg;
+  uint64 now;
+  struct hart *h = &harts[cpuid()];
+
+  acquire(&wheel.lock);
+  now = timer_now();
+  advance(now / TICKINTERVAL);
+  while((t = wheel.hr) != 0 && t->deadline <= now){
+    unlink(t);
+    t->pending = EXPIRED;
+    link(&wheel.expired, t);
+  }
+  wheel.nextdue = soonest();
+  while((t = wheel.expired) != 0){
+    unlink(t);
+    t->pending = 0;
+    fn = t->fn;
+    arg = t->arg;
+    wheel.nfired++;
+    // t may be gone as soon as the lock is released,
+    // unless its owner is waiting in timer_del_sync().
+    h->running = t;
+    release(&wheel.lock);
+    fn(arg);
+    acquire(&wheel.lock);
+    h->running = 0;
+  }
+  release(&wheel.lock);
+}
+
+static void
+sleepwakeup(void *chan)
+{
+  wakeup(chan);
+}
+
+// sleep until t fires, woken exactly once.
+// returns -1 if the process is killed first.
+// wheel.lock must be held.
+static int
+sleepon(struct timer *t)
+{
+  struct proc *p = myproc();
+
+  while(t->pending){
+    if(p->killed){
+      del(t);
+      return -1;
+    }
+    sleep(t, &wheel.lock);
+  }
+  return 0;
+}
+
+// sleep for n clock ticks.
+int
+timer_sleep(uint n)
+{
+  struct timer t;
+  int r;
+
+  acquire(&wheel.lock);
+  t.expires = timer_ticks() + n;
+  t.fn = sleepwakeup;
+  t.arg = &t;
+  add(&t);
+  r = sleepon(&t);
+  release(&wheel.lock);
+  return r;
+}
+
+// sleep until mtime reaches deadline.
+int
+timer_nanosleep(uint64 deadline)
+{
+  struct timer t;
+  int r;
+
+  acquire(&wheel.lock);
+  t.deadline = deadline;
+  t.fn = sleepwakeup;
+  t.arg = &t;
+  addhr(&t);
+  r = sleepon(&t);
+  release(&wheel.lock);
+  return r;
+}
+
+// handle a timer interrupt, either an Sstc supervisor timer
+// interrupt or one forwarded by timervec.
+// returns 1 if the running process's time slice is over.
+int
+timerintr(void)
+{
+  struct hart *h = &harts[cpuid()];
+  uint64 start = timer_now();
+  uint64 late;
+  int expired = 0;
+
+  // stimecmp stays pending until rewritten;
+  // timervec has already disarmed mtimecmp.
+  if(timer_sstc)
+    w_stimecmp(NEVER);
+
+  if(start >= h->armed){
+    late = start - h->armed;
+    h->latency += late;
+    if(late > h->maxlatency)
+      h->maxlatency = late;
+  }
+  h->armed = NEVER;
+  h->nintr++;
+
+  clockintr();
+  if(wheel.nextdue <= start)
+    runtimers();
+
+  if(start >= h->slice){
+    // the slice is over. the scheduler will
+    // hand out a new one to whatever runs next.
+    h->slice = NEVER;
+    expired = 1;
+  }
+  rearm(h);
+
+  if(mycpu()->proc == 0){
+    h->nidle++;
+    h->idlecycles += timer_now() - start;
+  }
+  return expired;
+}
+
+int
+timerstats(char *buf, int sz)
+{
+  int n, i;
+
+  n = snprintf(buf, sz, "uptime: %lu cycles, %d ticks, %s timer\n",
+               timer_now(), ticks, timer_sstc ? "sstc" : "clint");
+  n += snprintf(buf+n, sz-n, "timer: wheel: %d pending, %lu fired\n",
+                wheel.count, wheel.nfired);
+  for(i = 0; i < NCPU; i++){
+    struct hart *h = &harts[i];
+    if(h->nintr == 0 && timer_scratch[i][4] == 0)
+      continue;
+    n += snprintf(buf+n, sz-n,
+                  "timer: hart %d: %lu intr, %lu idle, %lu idle cycles, %lu mtraps\n",
+                  i, h->nintr, h->nidle, h->idlecycles, timer_scratch[i][4]);
+    n += snprintf(buf+n, sz-n,
+                  "timer: hart %d: latency %lu avg, %lu max cycles\n",
+                  i, h->nintr ? h->latency / h->nintr : 0, h->maxlatency);
+  }
+  return n;
+}
@@ -0,0 +1,15 @@
+// A one-shot kernel timer. Once ticks reaches expires (or
+// mtime reaches deadline, for hrtimer_add()), the clock
+// interrupt removes it from the timer wheel and calls fn(arg),
+// with no locks held.
+struct timer {
+  uint expires;           // tick at which to fire
+  uint64 deadline;        // or cycle, for hrtimer_add()
+  void (*fn)(void*);
+  void *arg;
+
+  // protected by the timer wheel's lock:
+  int pending;            // added, and fn not yet called? (timer.c)
+  struct timer *next;     // wheel slot, hr list, or expired list
+  struct timer **pprev;   // points at whatever points to us
+};
@@ -19,7 +19,7 @@ extern int devintr();
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
+  initlockkind(&tickslock, "time", LOCK_TICKET);
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -66,7 +66,7 @@ usertrap(void)
 
     syscall();
   } else if((which_dev = devintr()) != 0){
-    // ok
+    softirq();
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -106,6 +106,11 @@ usertrapret(void)
   p->trapframe->kernel_trap = (uint64)usertrap;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
 
+  // threads share the leader's page; only it updates the
+  // clock there, so that the sequence count has one writer.
+  if(p->leader == p)
+    timer_publish(p->usyscall);
+
   // set up the registers that trampoline.S's sret will use
   // to get to user space.
   
@@ -125,7 +130,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->tfva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -149,8 +154,11 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  softirq();
+
+  // give up the CPU if this is a timer interrupt, unless
+  // it arrived during bottom halves, which must finish here.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && !insoftirq())
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -159,19 +167,28 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// bring ticks up to date with the CLINT's mtime. with
+// one-shot timers there may not have been a clock
+// interrupt for a while. caller must hold tickslock.
+void
+tickupdate(void)
+{
+  ticks = timer_ticks();
+}
+
 void
 clockintr()
 {
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  tickupdate();
   release(&tickslock);
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
-// 1 if other device,
+// returns 2 if timer interrupt that ended the
+// running process's time slice,
+// 1 if other device or timer interrupt,
 // 0 if not recognized.
 int
 devintr()
@@ -181,38 +198,26 @@ devintr()
   if((scause & 0x8000000000000000L) &&
      (scause & 0xff) == 9){
     // this is a supervisor external interrupt, via PLIC.
-
-    // irq indicates which device interrupted.
-    int irq = plic_claim();
-
-    if(irq == UART0_IRQ){
-      uartintr();
-    } else if(irq == VIRTIO0_IRQ){
-      virtio_disk_intr();
-    } else if(irq){
-      printf("unexpected interrupt irq=%d\n", irq);
-    }
-
-    // the PLIC allows each device to raise at most one
-    // interrupt at a time; tell the PLIC the device is
-    // now allowed to interrupt again.
-    if(irq)
-      plic_complete(irq);
-
+    irqintr();
     return 1;
   } else if(scause == 0x8000000000000001L){
     // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // or from another hart's timer_kick(), forwarded by
+    // timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip. do this before timerintr()
+    // re-arms the timer, lest the next one be lost.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    if(timerintr())
+      return 2;
+    return 1;
+  } else if(scause == 0x8000000000000005L){
+    // supervisor timer interrupt, from stimecmp (Sstc).
+    if(timerintr())
+      return 2;
+    return 1;
   } else {
     return 0;
   }
@@ -28,6 +28,7 @@
 #define FCR_FIFO_ENABLE (1<<0)
 #define FCR_FIFO_CLEAR (3<<1) // clear the content of the two FIFOs
 #define ISR 2                 // interrupt status register
+#define ISR_NONE (1<<0)       // no interrupt pending
 #define LCR 3                 // line control register
 #define LCR_EIGHT_BITS (3<<0)
 #define LCR_BAUD_LATCH (1<<7) // special mode to set baud rate
@@ -45,6 +46,13 @@ char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
 
+// input taken by the top half, for the bottom half.
+struct spinlock uart_rx_lock;
+#define UART_RX_BUF_SIZE 64
+char uart_rx_buf[UART_RX_BUF_SIZE];
+uint64 uart_rx_w;
+uint64 uart_rx_r;
+
 extern volatile int panicked; // from printf.c
 
 void uartstart();
@@ -75,6 +83,7 @@ uartinit(void)
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
 
   initlock(&uart_tx_lock, "uart");
+  initlock(&uart_rx_lock, "uart_rx");
 }
 
 // add a character to the output buffer and tell the
@@ -173,21 +182,44 @@ uartgetc(void)
   }
 }
 
-// handle a uart interrupt, raised because input has
-// arrived, or the uart is ready for more output, or
-// both. called from trap.c.
+// the top half of a uart interrupt, raised because input has
+// arrived, or the uart is ready for more output, or both.
+// reading the ISR and the input is enough to quiet the uart;
+// uartbottom() does the rest. called from irq.c.
 void
 uartintr(void)
 {
-  // read and process incoming characters.
-  while(1){
-    int c = uartgetc();
-    if(c == -1)
+  int c;
+
+  acquire(&uart_rx_lock);
+  while((ReadReg(ISR) & ISR_NONE) == 0){
+    while((c = uartgetc()) != -1){
+      // drop input the bottom half hasn't kept up with.
+      if(uart_rx_w < uart_rx_r + UART_RX_BUF_SIZE)
+        uart_rx_buf[uart_rx_w++ % UART_RX_BUF_SIZE] = c;
+    }
+  }
+  release(&uart_rx_lock);
+}
+
+// the bottom half: process incoming characters, and
+// send buffered ones. called with interrupts on.
+void
+uartbottom(void)
+{
+  int c;
+
+  for(;;){
+    acquire(&uart_rx_lock);
+    if(uart_rx_r == uart_rx_w){
+      release(&uart_rx_lock);
       break;
+    }
+    c = uart_rx_buf[uart_rx_r++ % UART_RX_BUF_SIZE];
+    release(&uart_rx_lock);
     consoleintr(c);
   }
 
-  // send buffered characters.
   acquire(&uart_tx_lock);
   uartstart();
   release(&uart_tx_lock);
@@ -16,10 +16,15 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "waitqueue.h"
+#include "timer.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// ticks before disk_watchdog() complains about a request.
+#define DISKTIMEOUT 50
+
 static struct disk {
   // the virtio driver and device mostly communicate through a set of
   // structures in RAM. pages[] allocates that memory. pages[] is a
@@ -55,6 +60,7 @@ static struct disk {
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
+  struct waitqueue freewq; // for three free descriptors
   uint16 used_idx; // we've looked this far in used[2..NUM].
 
   // track info about in-flight operations,
@@ -79,6 +85,7 @@ virtio_disk_init(void)
   uint32 status = 0;
 
   initlock(&disk.vdisk_lock, "virtio_disk");
+  init_waitqueue(&disk.freewq, "virtio desc");
 
   if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
      *R(VIRTIO_MMIO_VERSION) != 1 ||
@@ -166,10 +173,10 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
-// free a chain of descriptors.
+// free a chain of descriptors, which is enough for
+// one waiting request.
 static void
 free_chain(int i)
 {
@@ -182,6 +189,7 @@ free_chain(int i)
     else
       break;
   }
+  wake_one(&disk.freewq);
 }
 
 // allocate three descriptors (they need not be contiguous).
@@ -200,10 +208,22 @@ alloc3_desc(int *idx)
   return 0;
 }
 
+// complain about a request the disk hasn't finished
+// within DISKTIMEOUT ticks. called from a kernel timer.
+static void
+disk_watchdog(void *arg)
+{
+  struct buf *b = arg;
+
+  printf("virtio disk: block %d not done after %d ticks\n",
+         b->blockno, DISKTIMEOUT);
+}
+
 void
 virtio_disk_rw(struct buf *b, int write)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
+  struct timer watchdog;
 
   acquire(&disk.vdisk_lock);
 
@@ -213,11 +233,13 @@ virtio_disk_rw(struct buf *b, int write)
 
   // allocate the three descriptors.
   int idx[3];
+  struct waitentry w;
+  init_waitentry(&w, 1);
   while(1){
     if(alloc3_desc(idx) == 0) {
       break;
     }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+    wait_on(&disk.freewq, &w, &disk.vdisk_lock);
   }
 
   // format the three descriptors.
@@ -266,31 +288,45 @@ virtio_disk_rw(struct buf *b, int write)
 
   __sync_synchronize();
 
+  // have the completion interrupt come to this hart.
+  irq_follow(VIRTIO0_IRQ);
+
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
+  timer_add(&watchdog, timer_ticks() + DISKTIMEOUT, disk_watchdog, b);
+
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
+  timer_del(&watchdog);
+
   disk.info[idx[0]].b = 0;
   free_chain(idx[0]);
 
   release(&disk.vdisk_lock);
 }
 
+// the top half of a disk interrupt. called from irq.c.
 void
 virtio_disk_intr()
 {
-  acquire(&disk.vdisk_lock);
-
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
   // this may race with the device writing new entries to
-  // the "used" ring, in which case we may process the new
-  // completion entries in this interrupt, and have nothing to do
-  // in the next interrupt, which is harmless.
+  // the "used" ring, in which case the bottom half may process
+  // the new completion entries, and have nothing to do
+  // after the next interrupt, which is harmless.
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+}
+
+// the bottom half: wake up the processes whose requests
+// have finished. called with interrupts on.
+void
+virtio_disk_bottom()
+{
+  acquire(&disk.vdisk_lock);
 
   __sync_synchronize();
 
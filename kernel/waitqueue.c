@@ -0,0 +1,190 @@
+//
+// wait queues: sleep until some event, and be woken with
+// either everyone else waiting for it, or alone. sleep() and
+// wakeup() on a shared channel wake every sleeper each time,
+// and for an event only one of them can use, such as a freed
+// disk descriptor, the rest just go back to sleep.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "waitqueue.h"
+#include "defs.h"
+
+#define NWQCLASS 16
+
+// the counters for all queues of one name, updated atomically.
+struct wqclass {
+  char *name;
+  uint64 nsleep;        // wait_on() calls
+  uint64 nwoken;        // waiters woken
+  uint64 nspurious;     // that found they had to wait again
+  uint64 nwakeall;      // wake_all() calls that woke anyone
+};
+
+static struct spinlock classlock;
+static struct wqclass classes[NWQCLASS];
+static int nclass;
+// for queues with new names once classes[] is full.
+static struct wqclass other = { "other" };
+
+void
+waitqueueinit(void)
+{
+  initlock(&classlock, "wqclass");
+}
+
+// the counters for queues named name.
+static struct wqclass*
+wqclass(char *name)
+{
+  struct wqclass *c;
+
+  acquire(&classlock);
+  for(c = classes; c < &classes[nclass]; c++)
+    if(strncmp(c->name, name, 32) == 0)
+      goto found;
+  if(nclass == NWQCLASS){
+    c = &other;
+    goto found;
+  }
+  c = &classes[nclass++];
+  c->name = name;
+found:
+  release(&classlock);
+  return c;
+}
+
+static void
+count(uint64 *n)
+{
+  __sync_fetch_and_add(n, 1);
+}
+
+void
+init_waitqueue(struct waitqueue *q, char *name)
+{
+  q->head = 0;
+  q->tail = &q->head;
+  q->class = wqclass(name);
+  q->affine = 0;
+}
+
+// exclusive waiters are woken one at a time by wake_one().
+void
+init_waitentry(struct waitentry *w, int exclusive)
+{
+  w->p = 0;
+  w->exclusive = exclusive;
+  w->woken = 0;
+  w->next = 0;
+}
+
+// remove w from q, if it is still there.
+static void
+dequeue(struct waitqueue *q, struct waitentry *w)
+{
+  struct waitentry **pp;
+
+  for(pp = &q->head; *pp; pp = &(*pp)->next){
+    if(*pp == w){
+      *pp = w->next;
+      if(q->tail == &w->next)
+        q->tail = pp;
+      w->next = 0;
+      return;
+    }
+  }
+}
+
+// sleep on q until woken, releasing lk meanwhile, like sleep().
+// lk must guard q. the caller checks its condition again on
+// return, since the wakeup may have been for someone else, or
+// from kill().
+void
+wait_on(struct waitqueue *q, struct waitentry *w, struct spinlock *lk)
+{
+  struct wqclass *c = q->class;
+
+  if(w->woken)
+    count(&c->nspurious);
+  w->woken = 0;
+  w->p = myproc();
+  w->next = 0;
+  *q->tail = w;
+  q->tail = &w->next;
+  count(&c->nsleep);
+
+  sleep(w, lk);
+
+  // kill() wakes without taking w off q.
+  if(!w->woken)
+    dequeue(q, w);
+}
+
+// wake the first waiter on q.
+// the lock that guards q must be held.
+static void
+wake(struct waitqueue *q)
+{
+  struct waitentry *w = q->head;
+  struct proc *p = w->p;
+
+  q->head = w->next;
+  if(q->head == 0)
+    q->tail = &q->head;
+  w->next = 0;
+  // once woken, w may be gone as soon as the lock is
+  // released, but not before.
+  w->woken = 1;
+  count(&q->class->nwoken);
+  wakeproc(p, w, q->affine);
+}
+
+// wake q's waiters up to and including the first exclusive one.
+// a waiter woken this way that doesn't use what it was woken
+// for should pass it on with another wake_one().
+// the lock that guards q must be held.
+void
+wake_one(struct waitqueue *q)
+{
+  int exclusive;
+
+  while(q->head){
+    exclusive = q->head->exclusive;
+    wake(q);
+    if(exclusive)
+      break;
+  }
+}
+
+// wake all of q's waiters.
+// the lock that guards q must be held.
+void
+wake_all(struct waitqueue *q)
+{
+  if(q->head)
+    count(&q->class->nwakeall);
+  while(q->head)
+    wake(q);
+}
+
+int
+waitqueuestats(char *buf, int sz)
+{
+  struct wqclass *c;
+  int i, n = 0;
+
+  for(i = 0; i <= nclass; i++){
+    c = i < nclass ? &classes[i] : &other;
+    if(c->nsleep == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "waitq %s: %lu sleeps, %lu woken, %lu spurious, %lu wake-alls\n",
+                  c->name, c->nsleep, c->nwoken, c->nspurious, c->nwakeall);
+  }
+  return n;
+}
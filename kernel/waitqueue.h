@@ -0,0 +1,26 @@
+// A queue of processes waiting for something, such as space in
+// the log or data in a pipe, guarded by the lock that guards
+// that something. Each waiter sleeps on its own entry, so
+// wake_one() can wake just the first exclusive waiter rather
+// than all of them, and neither wakeup searches the process
+// table. Set up with init_waitqueue(), then set affine if only
+// processes wake the queue, to pass along what they wrote.
+// Needs spinlock.h.
+struct waitqueue {
+  struct waitentry *head;
+  struct waitentry **tail;  // address of the last entry's next
+  struct wqclass *class;    // counters for queues of this name
+  int affine;               // woken by a process handing over data,
+                            // so run the waiter on the waker's hart
+};
+
+// A waiter's place in a queue, usually on its stack. Set up
+// with init_waitentry(), then pass to wait_on() in the loop that
+// waits for the condition; if the condition still doesn't hold
+// after a wakeup, that wakeup was spurious.
+struct waitentry {
+  struct proc *p;
+  int exclusive;            // wake_one() stops after waking this one
+  int woken;                // by wake_one() or wake_all()
+  struct waitentry *next;
+};
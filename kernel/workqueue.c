@@ -0,0 +1,189 @@
+//
+// workqueues: a worker kernel thread on each hart runs the
+// work queued there, in order, so that interrupt handlers
+// and latency-sensitive code can put off the rest of a job
+// to a context that may sleep.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "workqueue.h"
+#include "defs.h"
+
+// work->pending
+#define QUEUED  1
+#define DELAYED 2
+
+struct workqueue {
+  struct spinlock lock;
+  int started;
+  struct work *head;
+  struct work **tail;
+};
+
+static struct workqueue wqs[NCPU];
+
+// updated atomically, since each workqueue has its own lock,
+// except waitmax: a racing worker may lose an update of it,
+// which is tolerable in a statistic.
+static struct {
+  uint64 nqueued;       // works queued
+  uint64 ndelayed;      // of those, by queue_delayed_work()
+  uint64 nrun;          // fns called
+  uint64 waitmax;       // longest, in cycles, from queued to run
+} wstats;
+
+static void
+worker(void *arg)
+{
+  struct workqueue *wq = arg;
+  struct work *w;
+  void (*fn)(void*);
+  void *fnarg;
+  uint64 wait;
+
+  acquire(&wq->lock);
+  for(;;){
+    while((w = wq->head) == 0)
+      sleep(wq, &wq->lock);
+    if((wq->head = w->next) == 0)
+      wq->tail = &wq->head;
+    w->next = 0;
+    if((wait = timer_now() - w->queuedat) > wstats.waitmax)
+      wstats.waitmax = wait;
+    // fn may queue w again.
+    w->pending = 0;
+    fn = w->fn;
+    fnarg = w->arg;
+    release(&wq->lock);
+
+    fn(fnarg);
+    __sync_fetch_and_add(&wstats.nrun, 1);
+
+    acquire(&wq->lock);
+  }
+}
+
+// start the calling hart's worker.
+void
+workqueueinit(void)
+{
+  struct workqueue *wq = &wqs[cpuid()];
+
+  initlock(&wq->lock, "workqueue");
+  wq->tail = &wq->head;
+  if(kthread("kworker", worker, wq, 1 << cpuid()) == 0)
+    panic("workqueueinit");
+  wq->started = 1;
+}
+
+void
+init_work(struct work *w, void (*fn)(void*), void *arg)
+{
+  memset(w, 0, sizeof(*w));
+  w->fn = fn;
+  w->arg = arg;
+}
+
+// append w to its hart's workqueue. wq->lock must be held.
+static void
+enqueue(struct workqueue *wq, struct work *w)
+{
+  w->pending = QUEUED;
+  w->queuedat = timer_now();
+  w->next = 0;
+  *wq->tail = w;
+  wq->tail = &w->next;
+  __sync_fetch_and_add(&wstats.nqueued, 1);
+  wakeup(wq);
+}
+
+// the workqueue of hart cpu, or of this hart if cpu is -1
+// or hasn't started its worker.
+static struct workqueue*
+getwq(int cpu)
+{
+  if(cpu < 0 || cpu >= NCPU || !wqs[cpu].started){
+    push_off();
+    cpu = cpuid();
+    pop_off();
+  }
+  return &wqs[cpu];
+}
+
+// mark w pending as how, unless it already is. w may be
+// pending on another hart's workqueue, whose lock the caller
+// doesn't hold, so this is the only way to set it from 0.
+static int
+claim(struct work *w, int how)
+{
+  return __sync_bool_compare_and_swap(&w->pending, 0, how);
+}
+
+// queue w for the worker on hart cpu. returns 0 if w was
+// already pending. may be called from interrupt handlers.
+int
+queue_work_on(int cpu, struct work *w)
+{
+  struct workqueue *wq = getwq(cpu);
+
+  if(!claim(w, QUEUED))
+    return 0;
+  acquire(&wq->lock);
+  w->cpu = wq - wqs;
+  enqueue(wq, w);
+  release(&wq->lock);
+  return 1;
+}
+
+// queue w for this hart's worker.
+int
+queue_work(struct work *w)
+{
+  return queue_work_on(-1, w);
+}
+
+static void
+delayedfn(void *arg)
+{
+  struct work *w = arg;
+  struct workqueue *wq = &wqs[w->cpu];
+
+  acquire(&wq->lock);
+  if(w->pending == DELAYED)
+    enqueue(wq, w);
+  release(&wq->lock);
+}
+
+// queue w for this hart's worker once delay clock ticks
+// have passed. returns 0 if w was already pending.
+int
+queue_delayed_work(struct work *w, uint delay)
+{
+  struct workqueue *wq;
+
+  if(delay == 0)
+    return queue_work(w);
+  if(!claim(w, DELAYED))
+    return 0;
+  wq = getwq(-1);
+  acquire(&wq->lock);
+  w->cpu = wq - wqs;
+  __sync_fetch_and_add(&wstats.ndelayed, 1);
+  release(&wq->lock);
+  timer_add(&w->timer, timer_ticks() + delay, delayedfn, w);
+  return 1;
+}
+
+int
+workstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "work: %lu queued, %lu delayed, %lu run, %lu us max wait\n",
+                  wstats.nqueued, wstats.ndelayed, wstats.nrun,
+                  wstats.waitmax / (CLINT_FREQ/1000000));
+}
@@ -0,0 +1,19 @@
+// Deferred work: fn(arg), called later by a hart's worker
+// thread, in process context with no locks held, so fn may
+// sleep. Set up with init_work(), then pass to queue_work()
+// as many times as needed; a work that is already pending
+// isn't queued twice. A work can't be cancelled, so it must
+// not be freed while pending. Needs timer.h.
+struct work {
+  void (*fn)(void*);
+  void *arg;
+
+  int pending;            // queued or delayed, fn not yet called (workqueue.c);
+                          // set atomically, cleared under the lock below
+
+  // protected by the lock of the workqueue it is on:
+  int cpu;                // hart whose worker will run it
+  struct work *next;      // on the workqueue
+  uint64 queuedat;        // when it was last queued
+  struct timer timer;     // for queue_delayed_work()
+};
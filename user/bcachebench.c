@@ -0,0 +1,116 @@
+//
+// bcachebench [nharts [rounds]]: a process pinned to each of
+// nharts harts reads a small file of its own rounds times,
+// so that the blocks stay cached and every read is a buffer
+// cache hit, and reports the time per read, along with the
+// buffer cache's counters and how often its locks were
+// contended, from the lock profile.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NBLOCK 4
+
+static char buf[8192];
+
+static void
+bcstats(void)
+{
+  int fd, n, m;
+
+  showstats("bcache:");
+
+  if((fd = open("lockstat", O_RDONLY)) < 0)
+    return;
+  for(n = 0; n < sizeof(buf) - 1 && (m = read(fd, buf+n, sizeof(buf)-1-n)) > 0; n += m)
+    ;
+  close(fd);
+  buf[n] = 0;
+  printlines(buf, "name ");
+  printlines(buf, "bcache ");
+}
+
+static void
+resetstats(void)
+{
+  int fd;
+
+  if((fd = open("lockstat", O_WRONLY)) >= 0){
+    write(fd, "r", 1);
+    close(fd);
+  }
+}
+
+static char*
+name(int i)
+{
+  static char n[] = "bcb0";
+
+  n[3] = '0' + i;
+  return n;
+}
+
+static int rounds = 200;
+
+static int
+reads(int i)
+{
+  char b[BSIZE];
+  int j, fd;
+
+  for(j = 0; j < rounds; j++){
+    if((fd = open(name(i), O_RDONLY)) < 0)
+      return -1;
+    while(read(fd, b, sizeof(b)) > 0)
+      ;
+    close(fd);
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int harts[NCPU];
+  int i, j, n, fd, nharts;
+  uint64 ns;
+
+  n = myharts(harts);
+  nharts = n;
+  if(argc > 1)
+    nharts = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(nharts < 1 || nharts > n || rounds < 1){
+    fprintf(2, "usage: bcachebench [nharts (1-%d) [rounds]]\n", n);
+    exit(1);
+  }
+
+  memset(buf, 'x', BSIZE);
+  for(i = 0; i < nharts; i++){
+    if((fd = open(name(i), O_CREATE|O_WRONLY)) < 0){
+      fprintf(2, "bcachebench: cannot create %s\n", name(i));
+      exit(1);
+    }
+    for(j = 0; j < NBLOCK; j++)
+      write(fd, buf, BSIZE);
+    close(fd);
+  }
+
+  resetstats();
+  if(onharts(nharts, harts, reads, 0, &ns) < 0){
+    fprintf(2, "bcachebench: a child failed\n");
+    exit(1);
+  }
+
+  printf("bcachebench: %d harts x %d rounds of %d blocks: %d ns per block\n",
+         nharts, rounds, NBLOCK, (int)(ns / ((uint64)rounds * NBLOCK)));
+  bcstats();
+  for(i = 0; i < nharts; i++)
+    unlink(name(i));
+  exit(0);
+}
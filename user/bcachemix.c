@@ -0,0 +1,148 @@
+//
+// bcachemix [rounds]: reads NHOT small files in random order
+// rounds times, first alone and then while another process
+// reads a file bigger than the buffer cache over and over,
+// and reports the time per read and the buffer cache's
+// counters after each. a third process takes all the free
+// memory meanwhile, so that the cache is at its smallest.
+// if the scan pushes the small files' blocks, and the inode
+// and directory blocks they need, out of the cache, reads
+// take much longer the second time.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NHOT 16
+#define NSCAN 200     // blocks in the scanned file
+
+static char buf[4096];
+static uint rnd = 1;
+
+static uint
+random(void)
+{
+  rnd = rnd * 1103515245 + 12345;
+  return rnd >> 16;
+}
+
+static char*
+name(int i)
+{
+  static char n[] = "bcmaa";
+
+  n[3] = 'a' + i / 26;
+  n[4] = 'a' + i % 26;
+  return n;
+}
+
+static void
+create(char *file, int nblock)
+{
+  int fd, i;
+
+  if((fd = open(file, O_CREATE|O_WRONLY)) < 0){
+    fprintf(2, "bcachemix: cannot create %s\n", file);
+    exit(1);
+  }
+  memset(buf, 'x', BSIZE);
+  for(i = 0; i < nblock; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      fprintf(2, "bcachemix: write %s failed\n", file);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// read the hot files, and return the ns per read.
+static int
+hot(int rounds)
+{
+  uint64 t0;
+  int i, fd;
+
+  t0 = nsec();
+  for(i = 0; i < rounds * NHOT; i++){
+    if((fd = open(name(random() % NHOT), O_RDONLY)) < 0 ||
+       read(fd, buf, BSIZE) != BSIZE){
+      fprintf(2, "bcachemix: read failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  return (nsec() - t0) / (rounds * NHOT);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, rounds = 200, go[2], ready[2], scanner, hog;
+  char c;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds < 1){
+    fprintf(2, "usage: bcachemix [rounds]\n");
+    exit(1);
+  }
+
+  for(i = 0; i < NHOT; i++)
+    create(name(i), 1);
+  create("bcmscan", NSCAN);
+
+  if(pipe(go) < 0 || pipe(ready) < 0){
+    fprintf(2, "bcachemix: pipe failed\n");
+    exit(1);
+  }
+
+  scanner = fork();
+  if(scanner == 0){
+    close(go[1]);
+    read(go[0], &c, 1);
+    for(;;){
+      if((fd = open("bcmscan", O_RDONLY)) < 0)
+        exit(1);
+      while(read(fd, buf, sizeof(buf)) > 0)
+        ;
+      close(fd);
+    }
+  }
+
+  hog = fork();
+  if(hog == 0){
+    while(sbrk(64*4096) != (char*)-1)
+      ;
+    while(sbrk(4096) != (char*)-1)
+      ;
+    write(ready[1], "x", 1);
+    for(;;)
+      sleep(1000);
+  }
+  if(scanner < 0 || hog < 0 || read(ready[0], &c, 1) != 1){
+    fprintf(2, "bcachemix: fork failed\n");
+    exit(1);
+  }
+
+  hot(1);
+  printf("bcachemix: %d reads of %d files alone: %d ns per read\n",
+         rounds * NHOT, NHOT, hot(rounds));
+  showstats("bcache");
+
+  write(go[1], "x", 1);
+  printf("bcachemix: %d reads of %d files during a scan of %d blocks: %d ns per read\n",
+         rounds * NHOT, NHOT, NSCAN, hot(rounds));
+  showstats("bcache");
+
+  kill(scanner);
+  kill(hog);
+  wait(0);
+  wait(0);
+  for(i = 0; i < NHOT; i++)
+    unlink(name(i));
+  unlink("bcmscan");
+  exit(0);
+}
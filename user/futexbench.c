@@ -0,0 +1,96 @@
+//
+// futexbench [nthread [iters]]: threads contend for one
+// lock to increment a shared counter, first a spinlock that
+// never sleeps, then a futex-based mutex, and report the
+// time each took.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define MAXTHREAD 16
+#define STACKSZ 4096
+
+static int nthread = 4;
+static int iters = 10000;
+
+static struct mutex m;
+static int spin;
+static volatile int counter;
+static volatile int go;
+static char stacks[MAXTHREAD][STACKSZ];
+
+static void
+spinlocker(void *arg)
+{
+  while(!go)
+    ;
+  for(int i = 0; i < iters; i++){
+    while(__sync_lock_test_and_set(&spin, 1) != 0)
+      ;
+    counter++;
+    __sync_lock_release(&spin);
+  }
+  exit(0);
+}
+
+static void
+mutexlocker(void *arg)
+{
+  while(!go)
+    ;
+  for(int i = 0; i < iters; i++){
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+  exit(0);
+}
+
+static void
+run(char *name, void (*fn)(void*))
+{
+  int tids[MAXTHREAD];
+  uint64 t0, t1;
+  int i;
+
+  counter = 0;
+  go = 0;
+  for(i = 0; i < nthread; i++){
+    tids[i] = clone(fn, 0, stacks[i] + STACKSZ);
+    if(tids[i] < 0){
+      fprintf(2, "futexbench: clone failed\n");
+      exit(1);
+    }
+  }
+  t0 = nsec();
+  go = 1;
+  for(i = 0; i < nthread; i++)
+    join(tids[i], 0);
+  t1 = nsec();
+
+  if(counter != nthread * iters)
+    printf("%s: counter %d, expected %d\n", name, counter, nthread * iters);
+  printf("%s: %d threads x %d: %d ms, %d ns/op\n", name, nthread, iters,
+         (int)((t1 - t0) / 1000000), (int)((t1 - t0) / (nthread * iters)));
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1)
+    nthread = atoi(argv[1]);
+  if(argc > 2)
+    iters = atoi(argv[2]);
+  if(nthread < 1 || nthread > MAXTHREAD){
+    fprintf(2, "usage: futexbench [nthread (1-%d) [iters]]\n", MAXTHREAD);
+    exit(1);
+  }
+
+  run("spin", spinlocker);
+  mutex_init(&m);
+  showstats("futex:");
+  run("mutex", mutexlocker);
+  showstats("futex:");
+  exit(0);
+}
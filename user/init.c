@@ -2,6 +2,7 @@
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/param.h"
 #include "kernel/spinlock.h"
 #include "kernel/sleeplock.h"
 #include "kernel/fs.h"
@@ -23,6 +24,9 @@ main(void)
   dup(0);  // stdout
   dup(0);  // stderr
 
+  mknod("statistics", STATS, 0);  // fails harmlessly if it exists
+  mknod("lockstat", LOCKSTAT, 0);
+
   for(;;){
     printf("init: starting sh\n");
     pid = fork();
@@ -0,0 +1,75 @@
+//
+// lockbench [nharts [iters]]: a process pinned to each of
+// nharts harts takes and releases one kernel spinlock iters
+// times, for each kind of lock, and reports the time per
+// acquire, and the fastest and slowest hart's time, which
+// differ when the lock isn't handed out fairly.
+// run it under make CPUS=1 qemu up to CPUS=8 to see how
+// each kind scales.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/spinlock.h"
+#include "user/user.h"
+
+static char *kinds[] = {
+  [LOCK_TAS]    "tas",
+  [LOCK_TICKET] "ticket",
+  [LOCK_MCS]    "mcs",
+};
+
+static int nharts;
+static int iters = 100000;
+static int harts[NCPU];
+static int kind;
+
+static int
+acquires(int i)
+{
+  return lockbench(kind, iters);
+}
+
+static void
+run(void)
+{
+  int i, us[NCPU], min, max;
+  uint64 ns;
+
+  if(onharts(nharts, harts, acquires, us, &ns) < 0){
+    fprintf(2, "lockbench: a child failed\n");
+    exit(1);
+  }
+  min = max = us[0];
+  for(i = 1; i < nharts; i++){
+    if(us[i] < min)
+      min = us[i];
+    if(us[i] > max)
+      max = us[i];
+  }
+
+  printf("%s: %d harts x %d: %d ns/acquire, fastest hart %d ms, slowest %d ms\n",
+         kinds[kind], nharts, iters,
+         (int)((uint64)max * 1000 / ((uint64)nharts * iters)), min / 1000, max / 1000);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = myharts(harts);
+  nharts = n;
+  if(argc > 1)
+    nharts = atoi(argv[1]);
+  if(argc > 2)
+    iters = atoi(argv[2]);
+  if(nharts < 1 || nharts > n || iters < 1){
+    fprintf(2, "usage: lockbench [nharts (1-%d) [iters]]\n", n);
+    exit(1);
+  }
+
+  for(kind = 0; kind < sizeof(kinds)/sizeof(kinds[0]); kind++)
+    run();
+  exit(0);
+}
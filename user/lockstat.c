@@ -0,0 +1,59 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// lockstat: print the kernel's lock profile, one line per
+// lock name, most contended first.
+// lockstat -n N: just the N most contended.
+// lockstat -r: zero the counters.
+
+static char buf[8192];
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: lockstat [-r] [-n N]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, n, top = -1;
+  char *s;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-r") == 0){
+      if((fd = open("lockstat", O_WRONLY)) < 0 || write(fd, "r", 1) != 1){
+        fprintf(2, "lockstat: cannot reset\n");
+        exit(1);
+      }
+      close(fd);
+      exit(0);
+    } else if(strcmp(argv[i], "-n") == 0 && i+1 < argc){
+      top = atoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+
+  if((fd = open("lockstat", O_RDONLY)) < 0){
+    fprintf(2, "lockstat: cannot open lockstat\n");
+    exit(1);
+  }
+  for(n = 0; n < sizeof(buf) - 1; n += i)
+    if((i = read(fd, buf+n, sizeof(buf)-1-n)) <= 0)
+      break;
+  close(fd);
+  buf[n] = 0;
+
+  // the header, then top lines.
+  if(top >= 0){
+    for(s = buf, i = -1; *s && i < top; s++)
+      if(*s == '\n')
+        i++;
+    *s = 0;
+  }
+  printf("%s", buf);
+  exit(0);
+}
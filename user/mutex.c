@@ -0,0 +1,77 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Mutexes and condition variables for threads, which
+// spin only on the uncontended path and otherwise sleep
+// in the kernel with futex_wait().
+
+// m->v is 0 if unlocked, 1 if locked, and 2 if locked
+// with (perhaps) threads waiting for it.
+void
+mutex_init(struct mutex *m)
+{
+  m->v = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->v, 0, 1)) == 0)
+    return;
+  // mark it contended, so that the holder will wake us.
+  if(c != 2)
+    c = __atomic_exchange_n(&m->v, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex_wait(&m->v, 2, 0);
+    c = __atomic_exchange_n(&m->v, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+  return __sync_val_compare_and_swap(&m->v, 0, 1) == 0;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  // only make a system call if someone may be waiting.
+  if(__atomic_exchange_n(&m->v, 0, __ATOMIC_RELEASE) == 2)
+    futex_wake(&m->v, 1);
+}
+
+// c->seq counts signals, so a waiter that drops the
+// mutex just before a signal doesn't sleep through it.
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = c->seq;
+
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq, 0);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, NPROC);
+}
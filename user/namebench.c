@@ -0,0 +1,110 @@
+//
+// namebench [nharts [iters]]: a process pinned to each of
+// nharts harts looks up the same four-component path iters
+// times with stat(), and reports the time per lookup and how
+// many of the kernel's inode table lookups took no lock.
+// without nharts, it runs with 1, 2, 4, ... harts up to all
+// of them, and reports each run's speedup over one hart,
+// which stays near the number of harts only while lookups
+// don't contend.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define PATH "/namebench/a/b/f"
+
+static int iters = 2000;
+
+static void
+setup(void)
+{
+  int fd;
+
+  mkdir("/namebench");
+  mkdir("/namebench/a");
+  mkdir("/namebench/a/b");
+  if((fd = open(PATH, O_CREATE|O_RDWR)) < 0){
+    fprintf(2, "namebench: can't create %s\n", PATH);
+    exit(1);
+  }
+  close(fd);
+}
+
+static void
+cleanup(void)
+{
+  unlink(PATH);
+  unlink("/namebench/a/b");
+  unlink("/namebench/a");
+  unlink("/namebench");
+}
+
+static int
+lookups(int i)
+{
+  struct stat st;
+
+  for(int j = 0; j < iters; j++)
+    if(stat(PATH, &st) < 0)
+      return -1;
+  return 0;
+}
+
+// lookups per second with nharts harts.
+static uint64
+run(int *harts, int nharts)
+{
+  uint64 ns;
+
+  if(onharts(nharts, harts, lookups, 0, &ns) < 0){
+    fprintf(2, "namebench: a child failed\n");
+    cleanup();
+    exit(1);
+  }
+  printf("namebench: %d harts x %d lookups of %s: %d ns each",
+         nharts, iters, PATH, (int)(ns / iters));
+  return (uint64)nharts * iters * 1000000000 / ns;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int harts[NCPU];
+  int n, nharts = 0;
+  uint64 one, rate;
+
+  n = myharts(harts);
+  if(argc > 1)
+    nharts = atoi(argv[1]);
+  if(argc > 2)
+    iters = atoi(argv[2]);
+  if(nharts < 0 || nharts > n || iters < 1 || (argc > 1 && nharts == 0)){
+    fprintf(2, "usage: namebench [nharts (1-%d) [iters]]\n", n);
+    exit(1);
+  }
+
+  setup();
+  showstats("iget:");
+  if(nharts){
+    rate = run(harts, nharts);
+    printf(", %d lookups/s in all\n", (int)rate);
+  } else {
+    one = run(harts, 1);
+    printf(", %d lookups/s in all\n", (int)one);
+    for(nharts = 2; nharts / 2 < n; nharts *= 2){
+      if(nharts > n)
+        nharts = n;
+      rate = run(harts, nharts);
+      printf(", %d lookups/s in all, %d.%d times one hart\n", (int)rate,
+             (int)(rate / one), (int)(rate * 10 / one % 10));
+    }
+  }
+  showstats("iget:");
+  showstats("rcu:");
+  cleanup();
+  exit(0);
+}
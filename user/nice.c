@@ -0,0 +1,59 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// nice prio prog [args...]: run prog at scheduling priority prio.
+// nice -p pid [prio]: show, or set, pid's priority.
+// priorities run from 0, the most urgent, to NPRIO-1;
+// processes start at DEFPRIO.
+
+static int
+prio(char *s)
+{
+  if(*s < '0' || *s > '9')
+    return -1;
+  return atoi(s);
+}
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: nice prio prog [args...]\n");
+  fprintf(2, "       nice -p pid [prio]\n");
+  fprintf(2, "prio is 0 (most urgent) to %d; the default is %d\n", NPRIO-1, DEFPRIO);
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, p;
+
+  if(argc >= 3 && strcmp(argv[1], "-p") == 0){
+    pid = atoi(argv[2]);
+    if(argc == 4){
+      if((p = prio(argv[3])) < 0)
+        usage();
+      if(setpriority(pid, p) < 0){
+        fprintf(2, "nice: cannot set priority of %d\n", pid);
+        exit(1);
+      }
+    }
+    if((p = getpriority(pid)) < 0){
+      fprintf(2, "nice: no process %d\n", pid);
+      exit(1);
+    }
+    printf("pid %d's priority: %d\n", pid, p);
+    exit(0);
+  }
+
+  if(argc < 3 || (p = prio(argv[1])) < 0)
+    usage();
+  if(setpriority(0, p) < 0){
+    fprintf(2, "nice: bad priority %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv+2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,57 @@
+//
+// pipebench [n]: bounce a byte between two processes over
+// a pair of pipes n times, and report the round-trip time.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int n = 1000, i, pid;
+  int ping[2], pong[2];
+  char c = 'x';
+  uint64 t0, t1;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1){
+    fprintf(2, "usage: pipebench [n]\n");
+    exit(1);
+  }
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < n; i++){
+      if(read(ping[0], &c, 1) != 1)
+        break;
+      write(pong[1], &c, 1);
+    }
+    exit(0);
+  }
+
+  showstats("sched:");
+  t0 = nsec();
+  for(i = 0; i < n; i++){
+    write(ping[1], &c, 1);
+    if(read(pong[0], &c, 1) != 1){
+      fprintf(2, "pipebench: read failed\n");
+      exit(1);
+    }
+  }
+  t1 = nsec();
+  wait(0);
+
+  printf("pipebench: %d round trips, %d ns each\n", n, (int)((t1 - t0) / n));
+  showstats("sched:");
+  exit(0);
+}
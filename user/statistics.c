@@ -0,0 +1,55 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// read the kernel's statistics device into buf.
+// returns the number of bytes read.
+int
+statistics(void *buf, int sz)
+{
+  int fd, i, n;
+
+  fd = open("statistics", O_RDONLY);
+  if(fd < 0) {
+    fprintf(2, "stats: open failed\n");
+    exit(1);
+  }
+  for (i = 0; i < sz; ) {
+    if ((n = read(fd, buf+i, sz-i)) <= 0) {
+      break;
+    }
+    i += n;
+  }
+  close(fd);
+  return i;
+}
+
+// print the lines of the string s that start with prefix.
+void
+printlines(char *s, char *prefix)
+{
+  char *e;
+
+  for(; *s; s = e + 1){
+    if((e = strchr(s, '\n')) == 0)
+      break;
+    if(memcmp(s, prefix, strlen(prefix)) == 0){
+      *e = 0;
+      printf("%s\n", s);
+      *e = '\n';
+    }
+  }
+}
+
+// print the lines of the statistics device that start with prefix.
+void
+showstats(char *prefix)
+{
+  static char buf[4096];
+  int n;
+
+  n = statistics(buf, sizeof(buf) - 1);
+  buf[n] = 0;
+  printlines(buf, prefix);
+}
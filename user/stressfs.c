@@ -12,6 +12,7 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/date.h"
 
 int
 main(int argc, char *argv[])
@@ -19,8 +20,12 @@ main(int argc, char *argv[])
   int fd, i;
   char path[] = "stressfs0";
   char data[512];
+  struct timespec t0, t1;
+  int pid;
 
   printf("stressfs starting\n");
+  pid = getpid();
+  clock_gettime(&t0);
   memset(data, 'a', sizeof(data));
 
   for(i = 0; i < 4; i++)
@@ -45,5 +50,11 @@ main(int argc, char *argv[])
 
   wait(0);
 
+  if(getpid() == pid){
+    clock_gettime(&t1);
+    printf("stressfs: %d us\n",
+           (int)((t1.sec - t0.sec) * 1000000 + t1.nsec / 1000 - t0.nsec / 1000));
+  }
+
   exit(0);
 }
@@ -0,0 +1,94 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// taskset mask prog [args...]: run prog on the harts in mask.
+// taskset -p pid [mask]: show, or set, pid's affinity mask.
+// taskset -i irq [mask]: show, or set, the harts a device
+//   interrupt goes to; mask 0 sends it to the hart that last
+//   submitted work to the device, if the device allows.
+// masks are hex, one bit per hart: 0x1 is hart 0, 0x6 harts 1 and 2.
+
+static int
+hex(char *s)
+{
+  int n = 0;
+
+  if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    s += 2;
+  for(; *s; s++){
+    if(*s >= '0' && *s <= '9')
+      n = n*16 + *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      n = n*16 + *s - 'a' + 10;
+    else if(*s >= 'A' && *s <= 'F')
+      n = n*16 + *s - 'A' + 10;
+    else
+      return -1;
+  }
+  return n;
+}
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: taskset mask prog [args...]\n");
+  fprintf(2, "       taskset -p pid [mask]\n");
+  fprintf(2, "       taskset -i irq [mask]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, irq, mask;
+
+  if(argc >= 3 && strcmp(argv[1], "-p") == 0){
+    pid = atoi(argv[2]);
+    if(argc == 4){
+      if((mask = hex(argv[3])) <= 0)
+        usage();
+      if(sched_setaffinity(pid, mask) < 0){
+        fprintf(2, "taskset: cannot set affinity of %d\n", pid);
+        exit(1);
+      }
+    }
+    if((mask = sched_getaffinity(pid)) < 0){
+      fprintf(2, "taskset: no process %d\n", pid);
+      exit(1);
+    }
+    printf("pid %d's affinity mask: %x\n", pid, mask);
+    exit(0);
+  }
+
+  if(argc >= 3 && strcmp(argv[1], "-i") == 0){
+    irq = atoi(argv[2]);
+    if(argc == 4){
+      if((mask = hex(argv[3])) < 0)
+        usage();
+      if(irq_setaffinity(irq, mask) < 0){
+        fprintf(2, "taskset: cannot set affinity of irq %d\n", irq);
+        exit(1);
+      }
+    }
+    if((mask = irq_getaffinity(irq)) < 0){
+      fprintf(2, "taskset: no irq %d\n", irq);
+      exit(1);
+    }
+    if(mask == 0)
+      printf("irq %d follows the submitting hart\n", irq);
+    else
+      printf("irq %d's affinity mask: %x\n", irq, mask);
+    exit(0);
+  }
+
+  if(argc < 3 || (mask = hex(argv[1])) <= 0)
+    usage();
+  if(sched_setaffinity(0, mask) < 0){
+    fprintf(2, "taskset: no harts in mask %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv+2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -1,6 +1,10 @@
 #include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/date.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
 #include "user/user.h"
 
 char*
@@ -134,3 +138,110 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// getpid() and uptime() read the kernel's USYSCALL page
+// rather than trapping into the kernel.
+int
+getpid(void)
+{
+  return ((struct usyscall *)USYSCALL)->pid;
+}
+
+int
+uptime(void)
+{
+  volatile struct usyscall *u = (struct usyscall *)USYSCALL;
+  uint seq, ticks;
+  uint64 base, interval;
+
+  do {
+    seq = u->seq;
+    __sync_synchronize();
+    ticks = u->ticks;
+    base = u->base;
+    interval = u->interval;
+    __sync_synchronize();
+  } while((seq & 1) || seq != u->seq);
+
+  return ticks + (r_time() - base) / interval;
+}
+
+// the time, in nanoseconds, from clock_gettime().
+uint64
+nsec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(&ts);
+  return ts.sec * 1000000000 + ts.nsec;
+}
+
+// fill in the harts the caller may run on, and
+// return how many there are.
+int
+myharts(int *harts)
+{
+  int i, n = 0, mask = sched_getaffinity(0);
+
+  for(i = 0; i < NCPU; i++)
+    if(mask & (1 << i))
+      harts[n++] = i;
+  return n;
+}
+
+// for a benchmark: call fn(i) in n children, the i'th pinned
+// to harts[i], letting them all go at once, and put each
+// one's result in res[i], if res isn't 0, and the time from
+// letting them go until the last finished in *ns. returns -1
+// if a child couldn't be started or fn returned < 0.
+int
+onharts(int n, int *harts, int (*fn)(int), int *res, uint64 *ns)
+{
+  int start[2], done[2];
+  int i, pid, ok = 0, msg[2];
+  uint64 t0;
+  char c;
+
+  if(pipe(start) < 0)
+    return -1;
+  if(pipe(done) < 0){
+    close(start[0]);
+    close(start[1]);
+    return -1;
+  }
+  for(i = 0; i < n; i++){
+    if((pid = fork()) < 0)
+      break;
+    if(pid == 0){
+      close(start[1]);
+      close(done[0]);
+      sched_setaffinity(0, 1 << harts[i]);
+      if(read(start[0], &c, 1) != 1)
+        exit(1);
+      msg[0] = i;
+      msg[1] = fn(i);
+      write(done[1], msg, sizeof(msg));
+      exit(0);
+    }
+  }
+  n = i;
+  close(start[0]);
+  close(done[1]);
+
+  t0 = nsec();
+  // let them all go at once.
+  for(i = 0; i < n; i++)
+    write(start[1], "x", 1);
+  close(start[1]);
+  for(; ok < n; ok++){
+    if(read(done[0], msg, sizeof(msg)) != sizeof(msg) || msg[1] < 0)
+      break;
+    if(res)
+      res[msg[0]] = msg[1];
+  }
+  *ns = nsec() - t0;
+  close(done[0]);
+  for(i = 0; i < n; i++)
+    wait(0);
+  return ok == n && pid >= 0 ? 0 : -1;
+}
@@ -1,5 +1,6 @@
 struct stat;
 struct rtcdate;
+struct timespec;
 
 // system calls
 int fork(void);
@@ -19,13 +20,29 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int clock_gettime(struct timespec*);
+int nanosleep(struct timespec*);
+int clone(void (*)(void*), void*, void*);
+int join(int, int*);
+int futex_wait(int*, int, struct timespec*);
+int futex_wake(int*, int);
+int sched_setaffinity(int, int);
+int sched_getaffinity(int);
+int irq_setaffinity(int, int);
+int irq_getaffinity(int);
+int lockbench(int, int);
+int setpriority(int, int);
+int getpriority(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
+int getpid(void);
+int uptime(void);
+uint64 nsec(void);
+int myharts(int*);
+int onharts(int, int*, int (*)(int), int*, uint64*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
@@ -40,3 +57,24 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// statistics.c
+int statistics(void*, int);
+void printlines(char*, char*);
+void showstats(char*);
+
+// mutex.c
+struct mutex {
+  int v;
+};
+struct cond {
+  int seq;
+};
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
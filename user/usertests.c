@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/date.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -809,6 +810,793 @@ killstatus(char *s)
   exit(0);
 }
 
+#define TICK_NS ((uint64)TICKINTERVAL * 1000000000 / CLINT_FREQ)
+
+// clock_gettime() should advance, and nanosleep() should
+// sleep at least as long as asked but not a whole tick more.
+void
+clocktest(char *s)
+{
+  struct timespec a, b, d;
+  uint64 ns;
+
+  if(clock_gettime(&a) < 0 || clock_gettime(&b) < 0){
+    printf("%s: clock_gettime failed\n", s);
+    exit(1);
+  }
+  if(a.nsec >= 1000000000 || b.sec < a.sec ||
+     (b.sec == a.sec && b.nsec < a.nsec)){
+    printf("%s: clock went backwards\n", s);
+    exit(1);
+  }
+
+  d.sec = 0;
+  d.nsec = 1000000000;
+  if(nanosleep(&d) != -1){
+    printf("%s: nanosleep accepted nsec >= 1e9\n", s);
+    exit(1);
+  }
+
+  for(int i = 0; i < 10; i++){
+    d.sec = 0;
+    d.nsec = 2000000; // 2ms, well below a tick
+    clock_gettime(&a);
+    if(nanosleep(&d) < 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+    clock_gettime(&b);
+    ns = (b.sec - a.sec) * 1000000000 + b.nsec - a.nsec;
+    if(ns < d.nsec || ns >= d.nsec + TICK_NS){
+      printf("%s: slept %d ns, wanted %d\n", s, (int)ns, (int)d.nsec);
+      exit(1);
+    }
+  }
+}
+
+// getpid() and uptime() come from the USYSCALL page, which
+// user code must not be able to write.
+void
+usyscall(char *s)
+{
+  int fds[2], pid, cpid, xstatus;
+  uint t0, t1;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    cpid = getpid();
+    write(fds[1], &cpid, sizeof(cpid));
+    exit(0);
+  }
+  close(fds[1]);
+  if(read(fds[0], &cpid, sizeof(cpid)) != sizeof(cpid) || cpid != pid){
+    printf("%s: child getpid() %d, fork() said %d\n", s, cpid, pid);
+    exit(1);
+  }
+  close(fds[0]);
+  wait(0);
+
+  t0 = uptime();
+  sleep(2);
+  t1 = uptime();
+  if(t1 < t0 + 2){
+    printf("%s: uptime went from %d to %d across sleep(2)\n", s, t0, t1);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    ((struct usyscall *)USYSCALL)->pid = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: wrote the USYSCALL page\n", s);
+    exit(1);
+  }
+}
+
+#define NTHREAD 4
+#define TSTACK 4096
+
+static volatile int tcount;
+static volatile int tspin;
+static char *tbrk;
+
+static void
+tadd(void *arg)
+{
+  for(int i = 0; i < 1000; i++)
+    __sync_fetch_and_add(&tcount, 1);
+  exit((uint64)arg);
+}
+
+static void
+tsbrk(void *arg)
+{
+  tbrk = sbrk(PGSIZE);
+  tbrk[0] = 'x';
+  exit(getpid());
+}
+
+static void
+tforever(void *arg)
+{
+  tspin = 1;
+  for(;;)
+    ;
+}
+
+// clone() threads share memory, and join() collects them.
+void
+threads(char *s)
+{
+  int tids[NTHREAD], xstatus;
+  char *stacks;
+
+  stacks = malloc(NTHREAD * TSTACK);
+  tcount = 0;
+  for(int i = 0; i < NTHREAD; i++){
+    tids[i] = clone(tadd, (void*)(uint64)i, stacks + (i+1)*TSTACK);
+    if(tids[i] < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < NTHREAD; i++){
+    if(join(tids[i], &xstatus) != tids[i] || xstatus != i){
+      printf("%s: join %d failed\n", s, tids[i]);
+      exit(1);
+    }
+  }
+  if(tcount != NTHREAD * 1000){
+    printf("%s: count %d, wanted %d\n", s, tcount, NTHREAD * 1000);
+    exit(1);
+  }
+  if(join(tids[0], 0) != -1){
+    printf("%s: joined a thread twice\n", s);
+    exit(1);
+  }
+
+  // memory grown by a thread is visible to the others,
+  // and it has the same pid.
+  tids[0] = clone(tsbrk, 0, stacks + TSTACK);
+  if(join(tids[0], &xstatus) < 0 || xstatus != getpid() || tbrk[0] != 'x'){
+    printf("%s: thread sbrk or getpid wrong\n", s);
+    exit(1);
+  }
+
+  // exit() by the leader takes its threads with it,
+  // and exec() refuses while there are threads.
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    clone(tforever, 0, stacks + TSTACK);
+    while(tspin == 0)
+      ;
+    char *argv[] = { "echo", 0 };
+    exec("echo", argv);
+    exit(7);
+  }
+  wait(&xstatus);
+  if(xstatus != 7){
+    printf("%s: exec with threads, or leader exit, went wrong\n", s);
+    exit(1);
+  }
+  free(stacks);
+}
+
+static struct mutex fmu;
+static struct cond fcv;
+static int fready;
+static volatile int fcount;
+
+static void
+fmutex(void *arg)
+{
+  for(int i = 0; i < 2000; i++){
+    mutex_lock(&fmu);
+    fcount++;
+    mutex_unlock(&fmu);
+  }
+  exit(0);
+}
+
+static void
+fwaiter(void *arg)
+{
+  mutex_lock(&fmu);
+  while(!fready)
+    cond_wait(&fcv, &fmu);
+  mutex_unlock(&fmu);
+  exit(0);
+}
+
+// futex_wait() and futex_wake(), and the ulib mutex and
+// condition variable built on them.
+void
+futextest(char *s)
+{
+  int word = 1, tids[NTHREAD], xstatus;
+  struct timespec to, a, b;
+  char *stacks;
+
+  if(futex_wait(&word, 0, 0) != -1){
+    printf("%s: futex_wait slept on a changed word\n", s);
+    exit(1);
+  }
+  if(futex_wait((int*)((char*)&word + 1), 1, 0) != -1){
+    printf("%s: futex_wait took an unaligned address\n", s);
+    exit(1);
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf("%s: futex_wake woke someone\n", s);
+    exit(1);
+  }
+
+  to.sec = 0;
+  to.nsec = 10000000;
+  clock_gettime(&a);
+  if(futex_wait(&word, 1, &to) != -1){
+    printf("%s: futex_wait didn't time out\n", s);
+    exit(1);
+  }
+  clock_gettime(&b);
+  if((b.sec - a.sec) * 1000000000 + b.nsec - a.nsec < to.nsec){
+    printf("%s: futex_wait timed out early\n", s);
+    exit(1);
+  }
+
+  stacks = malloc(NTHREAD * TSTACK);
+  mutex_init(&fmu);
+  fcount = 0;
+  for(int i = 0; i < NTHREAD; i++)
+    tids[i] = clone(fmutex, 0, stacks + (i+1)*TSTACK);
+  for(int i = 0; i < NTHREAD; i++)
+    join(tids[i], 0);
+  if(fcount != NTHREAD * 2000){
+    printf("%s: mutex count %d, wanted %d\n", s, fcount, NTHREAD * 2000);
+    exit(1);
+  }
+
+  cond_init(&fcv);
+  fready = 0;
+  tids[0] = clone(fwaiter, 0, stacks + TSTACK);
+  sleep(1);
+  mutex_lock(&fmu);
+  fready = 1;
+  cond_signal(&fcv);
+  mutex_unlock(&fmu);
+  if(join(tids[0], &xstatus) != tids[0] || xstatus != 0){
+    printf("%s: cond_wait waiter didn't finish\n", s);
+    exit(1);
+  }
+  free(stacks);
+}
+
+// sched_setaffinity() pins a process, and fork() inherits it.
+void
+affinity(char *s)
+{
+  int all, pid, xstatus;
+
+  all = sched_getaffinity(0);
+  if(all <= 0){
+    printf("%s: sched_getaffinity failed\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 0) != -1){
+    printf("%s: empty mask accepted\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 1) < 0 || sched_getaffinity(0) != 1){
+    printf("%s: couldn't pin to hart 0\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(sched_getaffinity(0));
+  if(sched_getaffinity(pid) != 1){
+    printf("%s: can't see child's mask\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 1){
+    printf("%s: child didn't inherit mask\n", s);
+    exit(1);
+  }
+  sched_setaffinity(0, all);
+}
+
+// device interrupts can be pinned to a hart, and the disk's
+// can follow the hart that submits requests.
+void
+irqaffinity(char *s)
+{
+  int fd, old;
+  char buf[BSIZE];
+
+  old = irq_getaffinity(VIRTIO0_IRQ);
+  if(old < 0){
+    printf("%s: irq_getaffinity failed\n", s);
+    exit(1);
+  }
+  if(irq_getaffinity(0) != -1 || irq_setaffinity(0, 1) != -1){
+    printf("%s: irq 0 accepted\n", s);
+    exit(1);
+  }
+  if(irq_setaffinity(UART0_IRQ, 0) != -1){
+    printf("%s: uart can't follow a submitter\n", s);
+    exit(1);
+  }
+  for(int mask = 1; mask >= 0; mask--){
+    if(irq_setaffinity(VIRTIO0_IRQ, mask) < 0 || irq_getaffinity(VIRTIO0_IRQ) != mask){
+      printf("%s: couldn't set disk irq mask to %d\n", s, mask);
+      exit(1);
+    }
+    // the disk must still work.
+    fd = open("irqaff", O_CREATE|O_RDWR);
+    if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    unlink("irqaff");
+  }
+  irq_setaffinity(VIRTIO0_IRQ, old);
+}
+
+// exited children's memory is freed in the background;
+// it must still be there for the next child to use, even
+// when the children together use more than the machine has.
+void
+reapmem(char *s)
+{
+  int i, pid, xstatus;
+  char *a;
+
+  for(i = 0; i < 12; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      a = sbrk(16*1024*1024);
+      if(a == (char*)0xffffffffffffffffL)
+        exit(1);
+      for(char *p = a; p < a + 16*1024*1024; p += 4096)
+        *p = 1;
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child %d couldn't allocate memory\n", s, i);
+      exit(1);
+    }
+  }
+}
+
+// readers of one file share its inode lock; each must still
+// see the right data, and readers sharing a file descriptor
+// must each get a different part of the file.
+void
+sharedread(char *s)
+{
+  enum { NCHILD = 4, NBLOCK = 16 };
+  int fd, i, j, n, pid, xstatus, total;
+  static char buf[BSIZE];
+  int fds[2];
+
+  fd = open("sharedread", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NBLOCK; i++){
+    memset(buf, 'a' + i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  // half the children open the file themselves, and
+  // the others share one descriptor.
+  fd = open("sharedread", O_RDONLY);
+  for(i = 0; i < 2*NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      if(i < NCHILD){
+        close(fd);
+        fd = open("sharedread", O_RDONLY);
+      }
+      total = 0;
+      for(j = 0; (n = read(fd, buf, sizeof(buf))) > 0; j++){
+        if(n != sizeof(buf) || buf[0] != buf[n-1]){
+          printf("%s: short or torn read\n", s);
+          exit(1);
+        }
+        if(i < NCHILD && buf[0] != 'a' + j){
+          printf("%s: read block %d as %c\n", s, j, buf[0]);
+          exit(1);
+        }
+        total += n;
+      }
+      if(i < NCHILD && total != NBLOCK*BSIZE){
+        printf("%s: read %d bytes\n", s, total);
+        exit(1);
+      }
+      if(i >= NCHILD)
+        write(fds[1], &total, sizeof(total));
+      exit(0);
+    }
+  }
+  close(fd);
+  close(fds[1]);
+
+  for(i = 0; i < 2*NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  total = 0;
+  while(read(fds[0], &n, sizeof(n)) == sizeof(n))
+    total += n;
+  close(fds[0]);
+  if(total != NBLOCK*BSIZE){
+    printf("%s: sharers of a descriptor read %d bytes, not %d\n", s, total, NBLOCK*BSIZE);
+    exit(1);
+  }
+  unlink("sharedread");
+}
+
+// inode table entries are reused only after an RCU grace
+// period; using many more inodes than the table holds, one
+// after another, must wait for them rather than run out.
+void
+irecycle(char *s)
+{
+  char name[8];
+  int fd, i;
+
+  name[0] = 'i';
+  name[4] = 0;
+  for(i = 0; i < 2*NINODE; i++){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + (i / 10) % 10;
+    name[3] = '0' + i % 10;
+    fd = open(name, O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 0; i < 2*NINODE; i++){
+    name[1] = '0' + i / 100;
+    name[2] = '0' + (i / 10) % 10;
+    name[3] = '0' + i % 10;
+    if(unlink(name) < 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+}
+
+// several readers and writers on one pipe, each woken alone
+// when there is data or space: none may be left asleep, and
+// every byte written must be read once.
+void
+pipeherd(char *s)
+{
+  enum { NP = 4, NBYTES = 2000 };
+  int fds[2], counts[2], i, j, n, total, xstatus;
+  char buf[100];
+
+  if(pipe(fds) < 0 || pipe(counts) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*NP; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(counts[0]);
+      if(i < NP){
+        close(fds[0]);
+        memset(buf, 'a' + i, sizeof(buf));
+        for(j = 0; j < NBYTES; j += sizeof(buf))
+          if(write(fds[1], buf, sizeof(buf)) != sizeof(buf))
+            exit(1);
+      } else {
+        close(fds[1]);
+        total = 0;
+        while((n = read(fds[0], buf, sizeof(buf))) > 0)
+          total += n;
+        write(counts[1], &total, sizeof(total));
+      }
+      exit(0);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(counts[1]);
+
+  for(i = 0; i < 2*NP; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: a child failed\n", s);
+      exit(1);
+    }
+  }
+  total = 0;
+  while(read(counts[0], &n, sizeof(n)) == sizeof(n))
+    total += n;
+  close(counts[0]);
+  if(total != NP*NBYTES){
+    printf("%s: read %d bytes, not %d\n", s, total, NP*NBYTES);
+    exit(1);
+  }
+}
+
+// priorities are set and read back, refused out of range,
+// and inherited across fork().
+void
+priority(char *s)
+{
+  int old, pid, xstatus;
+
+  old = getpriority(0);
+  if(old < 0 || old >= NPRIO){
+    printf("%s: getpriority returned %d\n", s, old);
+    exit(1);
+  }
+  if(setpriority(0, -1) != -1 || setpriority(0, NPRIO) != -1){
+    printf("%s: out-of-range priority accepted\n", s);
+    exit(1);
+  }
+  if(setpriority(0, NPRIO-1) < 0 || getpriority(0) != NPRIO-1){
+    printf("%s: couldn't lower priority\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(getpriority(0) == NPRIO-1 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child didn't inherit priority\n", s);
+    exit(1);
+  }
+  if(setpriority(0, old) < 0 || getpriority(0) != old){
+    printf("%s: couldn't restore priority\n", s);
+    exit(1);
+  }
+}
+
+// a low-priority process holding a file's inode lock runs at
+// the priority of a more urgent one waiting for it, and goes
+// back to its own once it no longer holds it.
+void
+priorityinherit(char *s)
+{
+  char *file = "prioinherit", *stop = "prioinherit.stop";
+  int low, high, fd, p, seen, xstatus, hold[2];
+  struct timespec ms = { 0, 1000000 };
+  uint64 deadline;
+  char c;
+
+  unlink(file);
+  unlink(stop);
+  if(pipe(hold) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  // rewrite the same file over and over, each write holding
+  // its inode lock, until stop exists.
+  low = fork();
+  if(low == 0){
+    setpriority(0, NPRIO-1);
+    close(hold[1]);
+    while((fd = open(stop, O_RDONLY)) < 0){
+      if((fd = open(file, O_CREATE|O_WRONLY|O_TRUNC)) < 0)
+        exit(1);
+      for(int i = 0; i < 8; i++)
+        write(fd, buf, BSIZE * 3);
+      close(fd);
+    }
+    close(fd);
+    // holding no sleeplock now.
+    read(hold[0], &c, 1);
+    exit(0);
+  }
+  high = fork();
+  if(high == 0){
+    setpriority(0, 0);
+    while((fd = open(stop, O_RDONLY)) < 0){
+      if((fd = open(file, O_CREATE|O_WRONLY)) < 0)
+        exit(1);
+      write(fd, buf, BSIZE);
+      close(fd);
+    }
+    close(fd);
+    exit(0);
+  }
+  close(hold[0]);
+  if(low < 0 || high < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+
+  // look often, sleeping in between, so that on one hart
+  // the holder gets to run.
+  setpriority(0, 0);
+  seen = 0;
+  deadline = nsec() + 10 * 1000000000ULL;
+  while(!seen && nsec() < deadline){
+    if((p = getpriority(low)) >= 0 && p < NPRIO-1)
+      seen = 1;
+    nanosleep(&ms);
+  }
+
+  if((fd = open(stop, O_CREATE|O_WRONLY)) >= 0)
+    close(fd);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: writer failed\n", s);
+    exit(1);
+  }
+  // the other is done, or waiting for the parent.
+  for(int i = 0; i < 100 && getpriority(low) != NPRIO-1; i++)
+    sleep(1);
+  p = getpriority(low);
+  close(hold[1]);
+  wait(&xstatus);
+  unlink(file);
+  unlink(stop);
+  setpriority(0, DEFPRIO);
+  if(!seen){
+    printf("%s: holder never ran at its waiter's priority\n", s);
+    exit(1);
+  }
+  if(p != NPRIO-1){
+    printf("%s: holder kept priority %d after releasing\n", s, p);
+    exit(1);
+  }
+}
+
+// how many pages the buffer cache has given back, from the
+// "bcache:" statistics line, or -1.
+static int
+bcacheshrunk(void)
+{
+  static char st[4096];
+  char *p, *e;
+  int n;
+
+  n = statistics(st, sizeof(st) - 1);
+  st[n] = 0;
+  for(p = st; *p; p = e + 1){
+    if((e = strchr(p, '\n')) == 0)
+      break;
+    *e = 0;
+    if(memcmp(p, "bcache:", 7) == 0){
+      for(n = e - p - 7; n > 0 && memcmp(p + n, " shrunk,", 8) != 0; n--)
+        ;
+      while(n > 0 && p[n-1] >= '0' && p[n-1] <= '9')
+        n--;
+      return n > 0 ? atoi(p + n) : -1;
+    }
+  }
+  return -1;
+}
+
+// the buffer cache grows while a file is written, gives the
+// memory back when a process runs out, and still reads the
+// file right with no memory to spare.
+void
+bcachereclaim(char *s)
+{
+  enum { NBLK = 200 };
+  char *file = "bcachereclaim";
+  int fd, i, j, pid, xstatus, shrunk;
+
+  unlink(file);
+  fd = open(file, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NBLK; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  if((shrunk = bcacheshrunk()) < 0){
+    printf("%s: no bcache statistics\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // take all the memory there is, then read the file,
+    // with the cache at its smallest.
+    while(sbrk(64*PGSIZE) != (char*)-1)
+      ;
+    while(sbrk(PGSIZE) != (char*)-1)
+      ;
+    if((fd = open(file, O_RDONLY)) < 0){
+      printf("%s: open failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < NBLK; i++){
+      if(read(fd, buf, BSIZE) != BSIZE){
+        printf("%s: read failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < BSIZE; j++){
+        if(buf[j] != (char)i){
+          printf("%s: block %d wrong\n", s, i);
+          exit(1);
+        }
+      }
+    }
+    close(fd);
+    exit(0);
+  }
+  wait(&xstatus);
+  unlink(file);
+  if(xstatus != 0)
+    exit(1);
+  if(bcacheshrunk() <= shrunk){
+    printf("%s: the buffer cache gave back no memory\n", s);
+    exit(1);
+  }
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -2872,6 +3660,19 @@ main(int argc, char *argv[])
     {mem, "mem"},
     {pipe1, "pipe1"},
     {killstatus, "killstatus"},
+    {clocktest, "clocktest"},
+    {usyscall, "usyscall"},
+    {threads, "threads"},
+    {futextest, "futex"},
+    {affinity, "affinity"},
+    {reapmem, "reapmem"},
+    {irqaffinity, "irqaffinity"},
+    {sharedread, "sharedread"},
+    {irecycle, "irecycle"},
+    {pipeherd, "pipeherd"},
+    {priority, "priority"},
+    {priorityinherit, "priorityinherit"},
+    {bcachereclaim, "bcachereclaim"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -32,7 +32,18 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
+entry("clock_gettime");
+entry("nanosleep");
+entry("clone");
+entry("join");
+entry("futex_wait");
+entry("futex_wake");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("irq_setaffinity");
+entry("irq_getaffinity");
+entry("lockbench");
+entry("setpriority");
+entry("getpriority");